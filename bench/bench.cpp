@@ -0,0 +1,623 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "assembler.hpp"
+#include "batch.hpp"
+#include "config.hpp"
+#include "decode.hpp"
+#include "defines.hpp"
+#include "simd.hpp"
+#include "simpoint.hpp"
+#include "state.hpp"
+
+/*
+ * 模拟器吞吐量的基准测试.
+ * 输出格式与 Google Benchmark 的 JSON 输出兼容, 可以用 `scripts/bench_compare.py` 比较两次结果.
+ */
+
+template <class T> inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class BenchState {
+  public:
+    void pauseTiming() {
+        accumulate();
+        running = false;
+    }
+
+    void resumeTiming() {
+        running = true;
+        realStart = std::chrono::steady_clock::now();
+        cpuStart = std::clock();
+    }
+
+    uint64_t items = 0; /* 本次迭代处理的项目数, 例如周期数 */
+
+  private:
+    friend class Runner;
+    bool running = false;
+    double realTime = 0; /* 秒 */
+    double cpuTime = 0;  /* 秒 */
+    std::chrono::steady_clock::time_point realStart{};
+    std::clock_t cpuStart = 0;
+
+    void accumulate() {
+        if (!running)
+            return;
+        realTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+        cpuTime += double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    }
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(BenchState&)> body; /* 运行一次迭代, 在 `BenchState::items` 中累加处理的项目数 */
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double realTime; /* 每次迭代的纳秒数 */
+    double cpuTime;
+    double itemsPerSecond;
+};
+
+class Runner {
+  public:
+    explicit Runner(double minTime) : minTime(minTime) {
+    }
+
+    BenchResult run(const Benchmark& bench) const {
+        BenchState state{};
+        uint64_t iterations = 0;
+        while (state.realTime < minTime) {
+            state.resumeTiming();
+            bench.body(state);
+            state.pauseTiming();
+            iterations += 1;
+        }
+        return {bench.name, iterations, state.realTime * 1e9 / iterations, state.cpuTime * 1e9 / iterations,
+                state.items / state.realTime};
+    }
+
+  private:
+    double minTime;
+};
+
+/*
+ * 测试程序
+ */
+
+struct Program {
+    std::string name;
+    std::vector<word> words;
+};
+
+inline word r(word n) {
+    return n;
+}
+
+inline word offset(size_t from, size_t to) {
+    //* 从 `from` 处的跳转指令跳到 `to` 处的偏移量
+    return word(to - from - 1);
+}
+
+static std::vector<Program> programs() {
+    std::vector<Program> ret{};
+
+    // example/input1.asm
+    ret.push_back({"input1",
+                   {
+                       encodeI(ADDI, r(1), r(1), 1),
+                       encodeI(ADDI, r(10), r(10), 10),
+                       encodeI(ADDI, r(1), r(1), 3),
+                       encodeI(ADDI, r(10), r(10), -1),
+                       encodeI(BEQZ, r(10), r(0), offset(4, 6)),
+                       encodeJ(J, offset(5, 2)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    // example/input2.asm
+    ret.push_back({"input2",
+                   {
+                       encodeI(ADDI, r(1), r(1), 10),
+                       encodeI(ADDI, r(9), r(9), 1),
+                       encodeR(r(8), r(9), r(10), FUNC_ADD),
+                       encodeI(ADDI, r(9), r(8), 0),
+                       encodeI(ADDI, r(10), r(9), 0),
+                       encodeI(SW, r(2), r(10), 0),
+                       encodeI(ADDI, r(2), r(2), 1),
+                       encodeI(ADDI, r(1), r(1), -1),
+                       encodeI(BEQZ, r(1), r(0), offset(8, 10)),
+                       encodeJ(J, offset(9, 2)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    // example/input3.asm
+    ret.push_back({"input3",
+                   {
+                       encodeI(ADDI, r(1), r(1), 1),
+                       encodeI(ADDI, r(10), r(10), 10),
+                       encodeI(SW, r(2), r(1), 0),
+                       encodeI(ADDI, r(2), r(2), 1),
+                       encodeR(r(1), r(2), r(1), FUNC_ADD),
+                       encodeI(ADDI, r(10), r(10), -1),
+                       encodeI(BEQZ, r(10), r(0), offset(6, 8)),
+                       encodeJ(J, offset(7, 2)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    // 长循环: 计数器递减 30000 次
+    ret.push_back({"loop",
+                   {
+                       encodeI(ADDI, r(0), r(10), 30000),
+                       encodeI(ADDI, r(1), r(1), 3),
+                       encodeI(ADDI, r(10), r(10), -1),
+                       encodeI(BEQZ, r(10), r(0), offset(3, 5)),
+                       encodeJ(J, offset(4, 1)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    // 依赖链: 每次迭代有 8 条前后依赖的加法
+    {
+        std::vector<word> words{encodeI(ADDI, r(0), r(10), 5000), encodeI(ADDI, r(0), r(1), 1)};
+        size_t loop = words.size();
+        for (int i = 0; i < 8; ++i) {
+            words.push_back(encodeR(r(1), r(1), r(1), FUNC_ADD));
+        }
+        words.push_back(encodeI(ADDI, r(10), r(10), -1));
+        words.push_back(encodeI(BEQZ, r(10), r(0), offset(words.size(), words.size() + 2)));
+        words.push_back(encodeJ(J, offset(words.size(), loop)));
+        words.push_back(encodeJ(HALT, 0));
+        ret.push_back({"depchain", words});
+    }
+
+    // 分支密集: 按计数器奇偶交替跳转, 让预测器频繁出错
+    ret.push_back({"branchy",
+                   {
+                       encodeI(ADDI, r(0), r(10), 10000),
+                       encodeI(ANDI, r(10), r(3), 1),
+                       encodeI(BEQZ, r(3), r(0), offset(2, 4)),
+                       encodeI(ADDI, r(1), r(1), 1),
+                       encodeI(ADDI, r(2), r(2), 1),
+                       encodeI(ADDI, r(10), r(10), -1),
+                       encodeI(BEQZ, r(10), r(0), offset(6, 8)),
+                       encodeJ(J, offset(7, 1)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    // 访存: 写入后立即读回
+    ret.push_back({"memory",
+                   {
+                       encodeI(ADDI, r(0), r(10), 10000),
+                       encodeI(ANDI, r(10), r(2), 15),
+                       encodeI(SW, r(2), r(10), 0),
+                       encodeI(LW, r(2), r(3), 0),
+                       encodeR(r(1), r(3), r(1), FUNC_ADD),
+                       encodeI(ADDI, r(10), r(10), -1),
+                       encodeI(BEQZ, r(10), r(0), offset(6, 8)),
+                       encodeJ(J, offset(7, 1)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    // 访存冲突: store 的地址依赖一条 load, 之后读同一地址的 load 会越过它推测执行
+    ret.push_back({"alias",
+                   {
+                       encodeI(ADDI, r(0), r(10), 1000),
+                       encodeI(LW, r(0), r(4), 100),
+                       encodeR(r(4), r(4), r(5), FUNC_ADD),
+                       encodeI(SW, r(5), r(10), 200),
+                       encodeI(LW, r(0), r(3), 200),
+                       encodeR(r(1), r(3), r(1), FUNC_ADD),
+                       encodeI(ADDI, r(10), r(10), -1),
+                       encodeI(BEQZ, r(10), r(0), offset(7, 9)),
+                       encodeJ(J, offset(8, 1)),
+                       encodeJ(HALT, 0),
+                   }});
+
+    return ret;
+}
+
+static MachineState loaded(const std::vector<word>& words, const MachineConfig& config = {}) {
+    MachineState state{config};
+    state.loadImage(words.data(), words.size());
+    return state;
+}
+
+/*
+ * 基准测试
+ */
+
+static Benchmark runProgram(const std::string& name, const MachineState& start) {
+    //* 从 `start` 开始运行到 halt, 以周期数作为处理的项目数
+    auto init = std::make_shared<MachineState>(start);
+    return {name, [init](BenchState& state) {
+                state.pauseTiming();
+                auto machine = std::make_unique<MachineState>(*init);
+                state.resumeTiming();
+                while (!machine->nextStep()) {
+                }
+                state.items += machine->cycles;
+            }};
+}
+
+static std::vector<Benchmark> benchmarks() {
+    std::vector<Benchmark> ret{};
+
+    for (auto& prog : programs()) {
+        ret.push_back(runProgram("nextStep/" + prog.name, loaded(prog.words)));
+    }
+
+    // 大窗口配置: 128 项 ROB, 每类 16 个保留栈
+    MachineConfig wide{};
+    wide.robSize = 128;
+    wide.numLoad = wide.numStore = wide.numInt = 16;
+    for (auto& prog : programs()) {
+        ret.push_back(runProgram("nextStep/wide/" + prog.name, loaded(prog.words, wide)));
+    }
+
+    // 功能快进, 以执行的指令数作为处理的项目数; 与 nextStep 的每周期提交的指令数相比即为加速比
+    for (auto& prog : programs()) {
+        auto init = std::make_shared<MachineState>(loaded(prog.words));
+        ret.push_back({"fastForward/" + prog.name, [init](BenchState& state) {
+                           state.pauseTiming();
+                           auto machine = std::make_unique<MachineState>(*init);
+                           state.resumeTiming();
+                           state.items += machine->fastForward(UINT64_MAX).committed;
+                       }});
+    }
+
+    // 64 个相同实例的锁步模拟, 以各实例的周期数之和作为处理的项目数; 实例始终同组, 与 nextStep 相比即为锁步的加速比
+    for (auto& prog : programs()) {
+        auto init = std::make_shared<MachineState>(loaded(prog.words));
+        ret.push_back({"batch/64/" + prog.name, [init](BenchState& state) {
+                           state.pauseTiming();
+                           auto batch = std::make_unique<MachineBatch>(*init, 64);
+                           state.resumeTiming();
+                           batch->run(UINT64_MAX);
+                           for (auto c : batch->cycles)
+                               state.items += c;
+                       }});
+    }
+
+    // 抽样模拟的全部开销: 两次功能执行, 聚类, 以及单线程详细模拟选中的区间; 以程序的总指令数作为处理的项目数
+    for (auto& prog : programs()) {
+        auto init = std::make_shared<MachineState>(loaded(prog.words));
+        ret.push_back({"simpoint/" + prog.name, [init](BenchState& state) {
+                           SimPointOptions options{};
+                           options.interval = 1000;
+                           options.warmup = 200;
+                           state.items += simpoint(*init, options, 1).instructions;
+                       }});
+    }
+
+    // 256 项 ROB 上访存程序的 load/store 队列查找, 分别使用各级指令集
+    MachineConfig huge{};
+    huge.robSize = 256;
+    huge.numLoad = huge.numStore = huge.numInt = 16;
+    for (word level = SIMD_SCALAR; level < NUMSIMDLEVELS; ++level) {
+        if (level > supportedSimd())
+            continue;
+        for (auto& prog : programs()) {
+            if (prog.name != "memory" && prog.name != "alias")
+                continue;
+            auto init = std::make_shared<MachineState>(loaded(prog.words, huge));
+            ret.push_back({std::string("nextStep/rob256/") + simdlevelname[level] + "/" + prog.name,
+                           [init, level](BenchState& state) {
+                               state.pauseTiming();
+                               auto machine = std::make_unique<MachineState>(*init);
+                               auto saved = simdLevel;
+                               setSimdLevel(SimdLevel(level));
+                               state.resumeTiming();
+                               while (!machine->nextStep()) {
+                               }
+                               state.pauseTiming();
+                               setSimdLevel(saved);
+                               state.resumeTiming();
+                               state.items += machine->cycles;
+                           }});
+        }
+    }
+
+    // 各分支预测器在分支密集的程序上的开销
+    for (word kind = GSHARE; kind < NUMPREDICTORS; ++kind) {
+        MachineConfig config{};
+        config.predictor = kind;
+        for (auto& prog : programs()) {
+            if (prog.name == "branchy")
+                ret.push_back(runProgram(std::string("nextStep/") + predictorname[kind] + "/" + prog.name,
+                                         loaded(prog.words, config)));
+        }
+    }
+
+    // 写回时恢复: 每次预测错误都要保存检查点并清除错误路径
+    MachineConfig early{};
+    early.branchRecovery = WRITEBACK;
+    for (auto& prog : programs()) {
+        if (prog.name == "branchy")
+            ret.push_back(runProgram("nextStep/writeback/" + prog.name, loaded(prog.words, early)));
+    }
+
+    // 打开数据缓存时每次 load 和 store 都要查找标签
+    MachineConfig cached{};
+    cached.cacheSize = 256;
+    for (auto& prog : programs()) {
+        if (prog.name == "memory")
+            ret.push_back(runProgram("nextStep/l1/" + prog.name, loaded(prog.words, cached)));
+    }
+
+    // 打开跟踪时每个事件追加一条记录, 写入由后台线程完成; 包括最后关闭跟踪等待写完的时间
+    for (auto& prog : programs()) {
+        if (prog.name != "branchy")
+            continue;
+        auto init = std::make_shared<MachineState>(loaded(prog.words));
+        ret.push_back({"nextStep/trace/" + prog.name, [init](BenchState& state) {
+                           state.pauseTiming();
+                           auto machine = std::make_unique<MachineState>(*init);
+                           machine->startTrace("/dev/null");
+                           state.resumeTiming();
+                           while (!machine->nextStep()) {
+                           }
+                           machine->stopTrace();
+                           state.items += machine->cycles;
+                       }});
+    }
+
+    constexpr uint64_t BATCH = 1000;
+
+    ret.push_back({"broadcastUpdate", [](BenchState& state) {
+                       static MachineState machine{};
+                       for (uint64_t i = 0; i < BATCH; ++i) {
+                           for (auto& reserv : machine.reservation) {
+                               reserv.busy = true;
+                               reserv.Qj = INT1;
+                               reserv.Qk = LOAD1;
+                           }
+                           machine.waiters[INT1] = machine.waiters[LOAD1] = MachineState::bit(NUMUNITS + 1) - 1;
+                           machine.broadcastUpdate(INT1, i);
+                           machine.broadcastUpdate(LOAD1, i);
+                       }
+                       doNotOptimize(machine.reservation);
+                       state.items += 2 * BATCH;
+                   }});
+
+    ret.push_back({"issueInstr", [](BenchState& state) {
+                       static MachineState machine = loaded(programs()[1].words);
+                       for (uint64_t i = 0; i < BATCH; ++i) {
+                           auto pc = machine.pc + i % 10;
+                           auto robIdx = i % ROBSIZE;
+                           machine.issueInstr(pc, INT1, robIdx);
+                           machine.reservation[INT1] = {};
+                           machine.regResult = {};
+                       }
+                       doNotOptimize(machine.rob);
+                       state.items += BATCH;
+                   }});
+
+    ret.push_back({"getTarget", [](BenchState& state) {
+                       static MachineState machine{};
+                       for (word i = 0; i < BTBSIZE; ++i) {
+                           machine.updateBTB(100 + i, 200 + i, i % 2);
+                       }
+                       word sum = 0;
+                       for (uint64_t i = 0; i < BATCH; ++i) {
+                           sum += machine.getTarget(100 + i % (2 * BTBSIZE));
+                       }
+                       doNotOptimize(sum);
+                       state.items += BATCH;
+                   }});
+
+    // 4096 项, 8 路组相联的分支预测缓冲栈, 查找的开销应与 8 项时相当
+    ret.push_back({"getTarget/large", [](BenchState& state) {
+                       constexpr word ENTRIES = 4096;
+                       static MachineState machine = [] {
+                           MachineConfig config{};
+                           config.btbSize = ENTRIES;
+                           MachineState ret{config};
+                           for (word i = 0; i < ENTRIES; ++i) {
+                               ret.updateBTB(100 + i, 200 + i, i % 2);
+                           }
+                           return ret;
+                       }();
+                       word sum = 0;
+                       for (uint64_t i = 0; i < BATCH; ++i) {
+                           sum += machine.getTarget(100 + (i * 7919) % (2 * ENTRIES));
+                       }
+                       doNotOptimize(sum);
+                       state.items += BATCH;
+                   }});
+
+    ret.push_back({"updateBTB", [](BenchState& state) {
+                       static MachineState machine{};
+                       for (uint64_t i = 0; i < BATCH; ++i) {
+                           machine.updateBTB(100 + i % (2 * BTBSIZE), 200, i % 3);
+                       }
+                       doNotOptimize(machine.btb);
+                       state.items += BATCH;
+                   }});
+
+    ret.push_back({"commitInstr", [](BenchState& state) {
+                       static MachineState machine{};
+                       for (uint64_t i = 0; i < BATCH; ++i) {
+                           auto robIdx = machine.robPush();
+                           auto instr = encodeI(ADDI, r(1), r(2), 1);
+                           machine.rob[robIdx] =
+                               ROBEntry{true, true, false, 16, instr, predecode(instr), INT1, COMMITTING, word(i), 0};
+                           machine.commitInstr(robIdx);
+                       }
+                       doNotOptimize(machine.regFile);
+                       state.items += BATCH;
+                   }});
+
+    // 在 64 项中按地址比较, 以比较的项数作为处理的项目数
+    for (word level = SIMD_SCALAR; level < NUMSIMDLEVELS; ++level) {
+        if (level > supportedSimd())
+            continue;
+        auto kernel = matchKernel(SimdLevel(level));
+        ret.push_back({std::string("matchWords/") + simdlevelname[level], [kernel](BenchState& state) {
+                           static const std::vector<word> data = [] {
+                               std::vector<word> ret(64);
+                               for (word i = 0; i < 64; ++i)
+                                   ret[i] = i * 7 % 16;
+                               return ret;
+                           }();
+                           uint64_t bits = 0;
+                           for (uint64_t i = 0; i < BATCH; ++i)
+                               bits ^= kernel(data.data(), 64, i % 16);
+                           doNotOptimize(bits);
+                           state.items += 64 * BATCH;
+                       }});
+    }
+
+    // 汇编 10000 行带标号的程序, 以行数作为处理的项目数
+    ret.push_back({"assemble", [](BenchState& state) {
+                       static const std::string text = [] {
+                           std::string ret{};
+                           for (int i = 0; i < 10000; ++i) {
+                               ret += "l" + std::to_string(i) + " addi r" + std::to_string(i % 31 + 1) + ", r1, " +
+                                      std::to_string(i % 1000 - 500) + " ; comment\n";
+                               if (i % 8 == 7)
+                                   ret += "     beqz r" + std::to_string(i % 31 + 1) + ", l" + std::to_string(i / 2) +
+                                          "\n";
+                           }
+                           return ret + "     halt\n";
+                       }();
+                       auto words = Assembler::assemble(text);
+                       doNotOptimize(words.data());
+                       state.items += words.size();
+                   }});
+
+    // 复制整个状态, 打开与关闭写时复制的内存
+    for (word cow = 0; cow <= 1; ++cow) {
+        MachineConfig config{};
+        config.memCopyOnWrite = cow;
+        auto init = std::make_shared<MachineState>(loaded(programs()[1].words, config));
+        ret.push_back({cow ? "copyState/cow" : "copyState", [init](BenchState& state) {
+                           for (uint64_t i = 0; i < BATCH; ++i) {
+                               MachineState copy{*init};
+                               doNotOptimize(copy.memory);
+                           }
+                           state.items += BATCH;
+                       }});
+    }
+
+    return ret;
+}
+
+/*
+ * 输出
+ */
+
+static std::string jsonEscape(const std::string& str) {
+    std::string ret{};
+    for (auto ch : str) {
+        if (ch == '"' || ch == '\\')
+            ret += '\\';
+        ret += ch;
+    }
+    return ret;
+}
+
+static void writeJson(FILE* out, const char* executable, const std::vector<BenchResult>& results) {
+    char date[64];
+    auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    fprintf(out, "{\n  \"context\": {\n");
+    fprintf(out, "    \"date\": \"%s\",\n", date);
+    fprintf(out, "    \"executable\": \"%s\",\n", jsonEscape(executable).c_str());
+    fprintf(out, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+    fprintf(out, "    \"library_build_type\": \"release\"\n");
+#else
+    fprintf(out, "    \"library_build_type\": \"debug\"\n");
+#endif
+    fprintf(out, "  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& res = results[i];
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": \"%s\",\n", jsonEscape(res.name).c_str());
+        fprintf(out, "      \"run_name\": \"%s\",\n", jsonEscape(res.name).c_str());
+        fprintf(out, "      \"run_type\": \"iteration\",\n");
+        fprintf(out, "      \"iterations\": %llu,\n", (unsigned long long)res.iterations);
+        fprintf(out, "      \"real_time\": %.6e,\n", res.realTime);
+        fprintf(out, "      \"cpu_time\": %.6e,\n", res.cpuTime);
+        fprintf(out, "      \"time_unit\": \"ns\",\n");
+        fprintf(out, "      \"items_per_second\": %.6e\n", res.itemsPerSecond);
+        fprintf(out, i + 1 == results.size() ? "    }\n" : "    },\n");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "\n"
+            "  --filter <str>       only run benchmarks whose name contains <str>\n"
+            "  --min-time <sec>     minimum measuring time of each benchmark, default 0.5\n"
+            "  --json               print results as JSON instead of a table\n"
+            "  --out <file>         also write JSON results to <file>\n",
+            prog);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = "";
+    const char* outPath = nullptr;
+    double minTime = 0.5;
+    bool json = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            minTime = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else {
+            usage(argv[0]);
+            return !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") ? 0 : 1;
+        }
+    }
+
+    Runner runner{minTime};
+    std::vector<BenchResult> results{};
+    if (!json) {
+        printf("%-28s %14s %14s %12s %16s\n", "Benchmark", "Time(ns)", "CPU(ns)", "Iterations", "Items/s");
+    }
+    for (auto& bench : benchmarks()) {
+        if (bench.name.find(filter) == std::string::npos)
+            continue;
+        auto res = runner.run(bench);
+        if (!json) {
+            printf("%-28s %14.1f %14.1f %12llu %16.4g\n", res.name.c_str(), res.realTime, res.cpuTime,
+                   (unsigned long long)res.iterations, res.itemsPerSecond);
+            fflush(stdout);
+        }
+        results.push_back(res);
+    }
+
+    if (json)
+        writeJson(stdout, argv[0], results);
+    if (outPath) {
+        FILE* out = fopen(outPath, "w");
+        if (!out) {
+            fprintf(stderr, "Cannot open %s\n", outPath);
+            return 1;
+        }
+        writeJson(out, argv[0], results);
+        fclose(out);
+    }
+    return 0;
+}
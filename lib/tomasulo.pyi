@@ -1,12 +1,65 @@
 from enum import IntEnum
 from typing import Literal
 
+import numpy as np
+import numpy.typing as npt
+
+COUNTERS: bool
+
 class BHT(IntEnum):
     STRONGNOT: Literal[0]
     WEAKNOT: Literal[1]
     WEAKTAKEN: Literal[2]
     STORNGTAKEN: Literal[3]
 
+class StopReason(IntEnum):
+    HALTED: Literal[0]
+    BREAKPOINT: Literal[1]
+    WATCHPOINT: Literal[2]
+    CYCLE_LIMIT: Literal[3]
+    INSTR_LIMIT: Literal[4]
+
+class BTBReplacement(IntEnum):
+    LRU: Literal[0]
+    PLRU: Literal[1]
+
+class BranchRecovery(IntEnum):
+    COMMIT: Literal[0]
+    WRITEBACK: Literal[1]
+
+class TraceEvent(IntEnum):
+    EV_ISSUE: Literal[0]
+    EV_EXECUTE: Literal[1]
+    EV_BROADCAST: Literal[2]
+    EV_COMMIT: Literal[3]
+    EV_SQUASH: Literal[4]
+    EV_BTB: Literal[5]
+    EV_MEMWRITE: Literal[6]
+
+class SimdLevel(IntEnum):
+    SIMD_SCALAR: Literal[0]
+    SIMD_SSE2: Literal[1]
+    SIMD_AVX2: Literal[2]
+
+class PredictorKind(IntEnum):
+    BIMODAL: Literal[0]
+    GSHARE: Literal[1]
+    TOURNAMENT: Literal[2]
+    TAGE: Literal[3]
+
+class StopCondition:
+    breakPc: int
+    watchAddr: int
+    def __init__(self, breakPc: int = ..., watchAddr: int = ...) -> None: ...
+
+class RunSummary:
+    cycles: int
+    committed: int
+    halted: bool
+    reason: StopReason
+    @property
+    def ipc(self) -> float: ...
+
 class ResStation:
     busy: bool
     instr: int
@@ -20,6 +73,7 @@ class ResStation:
 class ROBEntry:
     busy: bool
     valid: bool
+    replay: bool
     pc: int
     instr: int
     execUnit: int
@@ -37,24 +91,257 @@ class BTBEntry:
     branchPc: int
     targetPc: int
 
+class MachineConfig:
+    robSize: int
+    numLoad: int
+    numStore: int
+    numInt: int
+    btbSize: int
+    btbWays: int
+    btbReplacement: int
+    btbTagBits: int
+    memSize: int
+    memCopyOnWrite: int
+    intExec: int
+    loadExec: int
+    storeExec: int
+    branchExec: int
+    issueWidth: int
+    commitWidth: int
+    numCDB: int
+    predictor: int
+    phtBits: int
+    historyBits: int
+    branchRecovery: int
+    recoveryLatency: int
+    cacheSize: int
+    cacheWays: int
+    cacheLineWords: int
+    cacheWriteBack: int
+    cacheWriteAllocate: int
+    cacheHitLatency: int
+    cacheMissLatency: int
+    def numUnits(self) -> int: ...
+    def unitName(self, unit: int) -> str: ...
+    def validate(self) -> None: ...
+    @staticmethod
+    def parse(text: str, source: str = "<string>") -> MachineConfig: ...
+    @staticmethod
+    def fromFile(path: str) -> MachineConfig: ...
+
+class BranchPredictor:
+    @property
+    def kind(self) -> int: ...
+    @property
+    def history(self) -> int: ...
+    @property
+    def specHistory(self) -> int: ...
+    @property
+    def phtView(self) -> np.ndarray: ...
+    @property
+    def localView(self) -> np.ndarray: ...
+    @property
+    def chooserView(self) -> np.ndarray: ...
+    @property
+    def taggedView(self) -> np.ndarray: ...
+
+class DataCache:
+    def enabled(self) -> bool: ...
+    @property
+    def linesView(self) -> np.ndarray: ...
+    @property
+    def replView(self) -> np.ndarray: ...
+
 class MachineState:
+    def __init__(self, config: MachineConfig = ...) -> None: ...
+    @property
+    def config(self) -> MachineConfig: ...
+    @property
+    def predictor(self) -> BranchPredictor: ...
+    @property
+    def cache(self) -> DataCache: ...
     pc: int
     cycles: int
+    fetchStall: int
     robHeadIdx: int
     robTailIdx: int
     rob: list[ROBEntry]
     reservation: list[ResStation]
     btb: list[BTBEntry]
+    btbRepl: list[int]
     regResult: list[RegResultEntry]
-    memory: list[int]
-    regFile: list[int]
+    # 只读快照: 每次访问复制整个地址空间 [0, memSize), 对它的修改会抛出 ValueError;
+    # memSize 为 0 (完整 32 位地址空间) 时访问会抛出异常. 修改内存用 writeMemory 或对 memory 整体赋值,
+    # 每周期查看一小段用 readMemory 或不复制的 memoryPage
+    memory: npt.NDArray[np.uint32]
+    regFile: npt.NDArray[np.uint32]
+    @property
+    def memoryPages(self) -> int: ...
+    # 第 number 页 (每页 1024 字) 的只读视图, 不复制, 内容为取出时的值
+    def memoryPage(self, number: int) -> npt.NDArray[np.uint32]: ...
+    def readMemory(self, address: int, count: int) -> npt.NDArray[np.uint32]: ...
+    def writeMemory(self, address: int, values: npt.ArrayLike) -> None: ...
+    # 以下视图只读; 修改这些表需整体赋值 rob, reservation, btb, btbRepl 或 regResult
+    @property
+    def robView(self) -> np.ndarray: ...
+    @property
+    def reservationView(self) -> np.ndarray: ...
+    @property
+    def btbView(self) -> np.ndarray: ...
+    @property
+    def btbReplView(self) -> np.ndarray: ...
+    @property
+    def regResultView(self) -> np.ndarray: ...
     def copy(self) -> MachineState: ...
     def nextStep(self) -> bool: ...
+    def run(self, maxCycles: int, cond: StopCondition = ...) -> RunSummary: ...
+    def runUntilHalt(self, maxCycles: int = ...) -> RunSummary: ...
+    def fastForward(self, maxInstrs: int, cond: StopCondition = ..., warm: bool = True) -> RunSummary: ...
     def loadInstr(self, pc: int, instr: bytes) -> None: ...
+    def loadProgram(self, text: str, source: str = "<string>") -> int: ...
+    def loadBinary(self, data: bytes) -> int: ...
     def setMemorySize(self, size: int) -> None: ...
+    def save(self, path: str) -> None: ...
+    @staticmethod
+    def load(path: str) -> MachineState: ...
+    def stats(self) -> dict[str, int | float | dict[str, int] | list[int]]: ...
+    def startTrace(self, path: str) -> None: ...
+    def stopTrace(self) -> None: ...
     def __copy__(self) -> MachineState: ...
     def __deepcopy__(self) -> MachineState: ...
 
+class History:
+    def __init__(self, initial: MachineState, keyframeInterval: int = 1024) -> None: ...
+    def record(self, state: MachineState) -> None: ...
+    def seek(self, cycle: int) -> MachineState: ...
+    def stepBack(self) -> MachineState: ...
+    def stepForward(self) -> MachineState: ...
+    def current(self) -> MachineState: ...
+    def latest(self) -> MachineState: ...
+    def memoryUsage(self) -> int: ...
+    def __len__(self) -> int: ...
+
+class TraceReader:
+    def __init__(self, path: str) -> None: ...
+    def size(self) -> int: ...
+    def tell(self) -> int: ...
+    def seek(self, index: int) -> None: ...
+    def read(self, count: int = ...) -> np.ndarray: ...
+    def __len__(self) -> int: ...
+    def __iter__(self) -> TraceReader: ...
+    def __next__(self) -> np.ndarray: ...
+
+class SweepResult:
+    @property
+    def config(self) -> MachineConfig: ...
+    @property
+    def cycles(self) -> int: ...
+    @property
+    def committed(self) -> int: ...
+    @property
+    def branches(self) -> int: ...
+    @property
+    def mispredicts(self) -> int: ...
+    @property
+    def stalls(self) -> int: ...
+    @property
+    def cacheHits(self) -> int: ...
+    @property
+    def cacheMisses(self) -> int: ...
+    @property
+    def halted(self) -> bool: ...
+    @property
+    def error(self) -> str: ...
+    @property
+    def ipc(self) -> float: ...
+    @property
+    def accuracy(self) -> float: ...
+    @property
+    def hitRate(self) -> float: ...
+
+def sweep(
+    program: MachineState,
+    configs: list[MachineConfig],
+    maxCycles: int = ...,
+    threads: int = 0,
+) -> list[SweepResult]: ...
+class MachineBatch:
+    def __init__(self, program: MachineState, count: int, threads: int = 0) -> None: ...
+    def __len__(self) -> int: ...
+    # 取出的是实例的副本, 修改之后需赋值回去; 赋值的实例单独成为一组
+    def __getitem__(self, index: int) -> MachineState: ...
+    def __setitem__(self, index: int, state: MachineState) -> None: ...
+    def step(self) -> bool: ...
+    def run(self, maxCycles: int) -> bool: ...
+    def readMemory(self, index: int, address: int, count: int) -> npt.NDArray[np.uint32]: ...
+    def writeMemory(self, index: int, address: int, values: npt.ArrayLike) -> None: ...
+    @property
+    def numGroups(self) -> int: ...
+    def isRunning(self, index: int) -> bool: ...
+    def setRunning(self, index: int, on: bool) -> None: ...
+    @property
+    def numRunning(self) -> int: ...
+    def counter(self, name: str) -> npt.NDArray[np.float64]: ...
+    @property
+    def regFile(self) -> npt.NDArray[np.uint32]: ...
+    @property
+    def pc(self) -> npt.NDArray[np.uint32]: ...
+    @property
+    def cycles(self) -> npt.NDArray[np.uint64]: ...
+    @property
+    def committed(self) -> npt.NDArray[np.uint64]: ...
+    @property
+    def halted(self) -> npt.NDArray[np.uint8]: ...
+
+class SimPointSample:
+    @property
+    def interval(self) -> int: ...
+    @property
+    def cluster(self) -> int: ...
+    @property
+    def cycles(self) -> int: ...
+    @property
+    def committed(self) -> int: ...
+    @property
+    def cpi(self) -> float: ...
+
+class SimPointResult:
+    @property
+    def interval(self) -> int: ...
+    @property
+    def instructions(self) -> int: ...
+    @property
+    def clusters(self) -> int: ...
+    @property
+    def labels(self) -> list[int]: ...
+    @property
+    def weights(self) -> list[float]: ...
+    @property
+    def samples(self) -> list[SimPointSample]: ...
+    @property
+    def detailed(self) -> int: ...
+    @property
+    def cpi(self) -> float: ...
+    @property
+    def cpiError(self) -> float: ...
+    @property
+    def truncated(self) -> bool: ...
+    @property
+    def ipc(self) -> float: ...
+
+def simpoint(
+    program: MachineState,
+    interval: int = 100000,
+    clusters: int = 10,
+    samples: int = 3,
+    warmup: int = 10000,
+    seed: int = 1,
+    maxInstructions: int = ...,
+    threads: int = 0,
+) -> SimPointResult: ...
+def assemble(text: str, source: str = "<string>") -> np.ndarray: ...
 def printState(state: MachineState, memorySize: int) -> None: ...
+def simdLevel() -> SimdLevel: ...
+def setSimdLevel(level: SimdLevel) -> SimdLevel: ...
 
 class TomasuloError(Exception): ...
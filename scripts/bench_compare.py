@@ -0,0 +1,55 @@
+#! /usr/bin/env python3
+
+import argparse
+import json
+from pathlib import Path
+import sys
+
+
+def load(path: Path):
+    with path.open("r") as f:
+        data = json.load(f)
+    return {bench["name"]: bench for bench in data["benchmarks"]}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="compare two JSON outputs of tomasulo-bench"
+    )
+    parser.add_argument("baseline", type=Path)
+    parser.add_argument("contender", type=Path)
+    parser.add_argument(
+        "-t",
+        "--threshold",
+        type=float,
+        default=5.0,
+        help="report a regression when throughput drops by more than this percentage",
+    )
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    baseline = load(args.baseline)
+    contender = load(args.contender)
+
+    regressed = False
+    print(f"{'Benchmark':<28} {'Base items/s':>14} {'New items/s':>14} {'Change':>9}")
+    for name, base in baseline.items():
+        if name not in contender:
+            print(f"{name:<28} {'missing in contender':>39}")
+            continue
+        old = base["items_per_second"]
+        new = contender[name]["items_per_second"]
+        change = (new - old) / old * 100
+        mark = ""
+        if change < -args.threshold:
+            mark = "  <-- regression"
+            regressed = True
+        print(f"{name:<28} {old:>14.4g} {new:>14.4g} {change:>+8.1f}%{mark}")
+
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,90 @@
+#! /usr/bin/env python3
+
+import argparse
+from pathlib import Path
+import struct
+import sys
+
+import numpy as np
+
+# 与 src/trace.hpp 中的文件格式一致, 不需要编译好的模块即可读取
+TRACE_MAGIC = b"TOMATRCE"
+TRACE_VERSION = 1
+TRACE_HEADER = struct.Struct("<8sII")
+TRACE_DTYPE = np.dtype(
+    [
+        ("cycle", "<u4"),
+        ("event", "u1"),
+        ("unit", "u1"),
+        ("robIdx", "<u2"),
+        ("pc", "<u4"),
+        ("value", "<u4"),
+    ]
+)
+EVENT_NAMES = ["issue", "execute", "broadcast", "commit", "squash", "btb", "memwrite"]
+
+
+def read_trace(path: Path, chunk: int = 1 << 16):
+    """逐块产生跟踪记录的 numpy 数组, 不需要把整个文件读入内存"""
+    with path.open("rb") as f:
+        header = f.read(TRACE_HEADER.size)
+        if len(header) != TRACE_HEADER.size:
+            raise ValueError(f"{path}: not a trace file")
+        magic, version, record_size = TRACE_HEADER.unpack(header)
+        if magic != TRACE_MAGIC:
+            raise ValueError(f"{path}: not a trace file")
+        if version != TRACE_VERSION or record_size != TRACE_DTYPE.itemsize:
+            raise ValueError(f"{path}: unsupported trace version {version}")
+        if (path.stat().st_size - TRACE_HEADER.size) % TRACE_DTYPE.itemsize != 0:
+            raise ValueError(f"{path}: truncated trace")
+        while True:
+            records = np.fromfile(f, dtype=TRACE_DTYPE, count=chunk)
+            if records.size == 0:
+                return
+            yield records
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="summarize a pipeline trace written by `tomasulo-sim --trace`"
+    )
+    parser.add_argument("trace", type=Path)
+    parser.add_argument(
+        "-w",
+        "--window",
+        type=int,
+        default=0,
+        help="also print the IPC of every window of this many cycles",
+    )
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    counts = np.zeros(len(EVENT_NAMES), dtype=np.int64)
+    window_commits: dict[int, int] = {}
+    last_cycle = 0
+    for records in read_trace(args.trace):
+        counts += np.bincount(records["event"], minlength=len(EVENT_NAMES))[: len(EVENT_NAMES)]
+        last_cycle = int(records["cycle"][-1])
+        if args.window > 0:
+            commits = records["cycle"][records["event"] == EVENT_NAMES.index("commit")]
+            windows, n = np.unique(commits // args.window, return_counts=True)
+            for w, c in zip(windows.tolist(), n.tolist()):
+                window_commits[w] = window_commits.get(w, 0) + c
+
+    print(f"{'event':<10} {'count':>12}")
+    for name, count in zip(EVENT_NAMES, counts.tolist()):
+        print(f"{name:<10} {count:>12}")
+    committed = int(counts[EVENT_NAMES.index("commit")])
+    print(f"cycles {last_cycle}, IPC {committed / last_cycle if last_cycle else 0:.4f}")
+    for w in range(last_cycle // args.window + 1 if args.window > 0 else 0):
+        print(f"{w * args.window:>12} {window_commits.get(w, 0) / args.window:>8.4f}")
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except ValueError as e:
+        print(f"error: {e}", file=sys.stderr)
+        sys.exit(1)
@@ -18,8 +18,6 @@ import tkinter.messagebox as msg
 from tkinter import filedialog as fdl
 from tksheet import Sheet
 
-from scripts.assembler import translate
-
 
 if not os.path.isfile("lib/tomasulo.so"):
     import subprocess
@@ -30,17 +28,17 @@ if not os.path.isfile("lib/tomasulo.so"):
 import lib.tomasulo as t
 
 instr_state = ["ISSUING", "EXECUTING", "WRITING_RESULT", "COMMITTING"]
-units = ["READY", "LOAD1", "LOAD2", "STORE1", "STORE2", "INT1", "INT2"]
+
+ROB_HEADERS = ["busy", "valid", "replay", "pc", "instr", "instr status", "exec unit", "result", "address"]
+RESERV_HEADERS = ["busy", "instr", "Vj", "Vk", "Qj", "Qk", "exec time left", "ROB index"]
+BTB_HEADERS = ["valid", "branch PC", "target PC", "pred"]
+REG_HEADERS = ["value", "valid", "result #ROB"]
 
 
-def load_asm(path: str):
+def load_asm(machine: "t.MachineState", path: str):
     with open(path, "r") as f:
         a = f.read()
-    try:
-        b = translate(a)
-    except Exception as e:
-        raise ValueError("Invalid asm") from e
-    return a.splitlines(), [b[i * 4 : (i + 1) * 4] for i in range(len(b) // 4)]
+    return a.splitlines(), machine.loadProgram(a, path)
 
 
 def sheet(
@@ -61,8 +59,126 @@ def sheet(
     return Sheet(**args, **kwargs)
 
 
-class GUI:
-    def __init__(self, autospeed: int = 200) -> None:
+class Tables:
+    """the rows of each table shown by the GUI, computed from `self.view`"""
+
+    def __init__(self, config: "t.MachineConfig | None" = None) -> None:
+        self.config = config if config is not None else t.MachineConfig()
+        self.units = [
+            self.config.unitName(i) for i in range(self.config.numUnits() + 1)
+        ]
+        self.view = t.MachineState(self.config)
+        self.memsize = 0
+
+    @property
+    def current_state(self):
+        return self.view
+
+    @property
+    def current_pc(self):
+        return f"PC: {self.current_state.pc}"
+
+    @property
+    def current_cycle(self):
+        return f"Cycles: {self.current_state.cycles}"
+
+    @property
+    def current_reg(self):
+        state = self.current_state
+        result = state.regResultView
+        return list(
+            zip(
+                state.regFile.tolist(),
+                result["valid"].tolist(),
+                result["robIdx"].tolist(),
+            )
+        )
+
+    @property
+    def current_memory(self):
+        state = self.current_state
+        return [(word,) for word in state.readMemory(0, self.memsize).tolist()]
+
+    @property
+    def current_rob(self):
+        # 按字段名读取, ROBEntry 增加字段时不必修改这里
+        rob = self.current_state.robView
+        return [
+            (
+                bool(e["busy"]),
+                bool(e["valid"]),
+                bool(e["replay"]),
+                int(e["pc"]),
+                int(e["instr"]),
+                instr_state[e["instrStatus"]],
+                self.units[e["execUnit"]],
+                int(e["result"]),
+                int(e["address"]),
+            )
+            for e in rob
+        ]
+
+    @property
+    def current_reserv(self):
+        reserv = self.current_state.reservationView[1:]
+        return [
+            (
+                bool(e["busy"]),
+                int(e["instr"]),
+                int(e["Vj"]),
+                int(e["Vk"]),
+                self.units[e["Qj"]],
+                self.units[e["Qk"]],
+                int(e["exTimeLeft"]),
+                int(e["robIdx"]),
+            )
+            for e in reserv
+        ]
+
+    @property
+    def current_btb(self):
+        btb = self.current_state.btbView
+        return [
+            (
+                bool(e["valid"]),
+                int(e["branchPc"]),
+                int(e["targetPc"]),
+                t.BHT(e["branchPred"]).name,
+            )
+            for e in btb
+        ]
+
+
+def check(path: str, config: "t.MachineConfig | None" = None, max_cycles: int = 100000) -> int:
+    """run `path` without a window and build every table on every recorded cycle, returns the number of cycles"""
+    tables = Tables(config)
+    machine = t.MachineState(tables.config)
+    _, size = load_asm(machine, path)
+    tables.memsize = machine.pc + size
+    history = t.History(machine)
+    halted = False
+    while not halted and len(history) <= max_cycles:
+        halted = machine.nextStep()
+        history.record(machine)
+    expected = [
+        (lambda: tables.current_rob, len(ROB_HEADERS)),
+        (lambda: tables.current_reserv, len(RESERV_HEADERS)),
+        (lambda: tables.current_btb, len(BTB_HEADERS)),
+        (lambda: tables.current_reg, len(REG_HEADERS)),
+        (lambda: tables.current_memory, 1),
+    ]
+    for cycle in range(len(history)):
+        tables.view = history.seek(cycle)
+        for rows, width in expected:
+            for row in rows():
+                if len(row) != width:
+                    raise AssertionError(f"cycle {cycle}: row {row} does not match {width} headers")
+    return len(history)
+
+
+class GUI(Tables):
+    def __init__(self, autospeed: int = 200, config: "t.MachineConfig | None" = None) -> None:
+        super().__init__(config)
         self.init()
         self.autospeed = autospeed
 
@@ -116,7 +232,7 @@ class GUI:
         reg_sheet = sheet(
             reg_frame,
             self.current_reg,
-            ["value", "valid", "result #ROB"],
+            REG_HEADERS,
             [f"r{i}" for i in range(32)],
             height=20 * 33,
             width=400,
@@ -153,7 +269,7 @@ class GUI:
         btb_sheet = sheet(
             btb_frame,
             btb,
-            ["valid", "branch PC", "target PC", "pred"],
+            BTB_HEADERS,
             list(range(len(btb))),
             width=500,
             height=20 * (len(btb) + 1),
@@ -193,16 +309,7 @@ class GUI:
         rob_sheet = sheet(
             rob_frame,
             current_rob,
-            [
-                "busy",
-                "valid",
-                "pc",
-                "instr",
-                "instr status",
-                "exec unit",
-                "result",
-                "address",
-            ],
+            ROB_HEADERS,
             [i for i in range(rob_size)],
             height=20 * (rob_size + 1),
             row_height=20,
@@ -218,9 +325,9 @@ class GUI:
         reserv_sheet = sheet(
             reserv_frame,
             self.current_reserv,
-            ["busy", "instr", "Vj", "Vk", "Qj", "Qk", "exec time left", "ROB index"],
-            units[1:],
-            height=140,
+            RESERV_HEADERS,
+            self.units[1:],
+            height=20 * len(self.units),
             row_height=20,
             width=900,
         )
@@ -232,7 +339,9 @@ class GUI:
         window.mainloop()
 
     def init(self):
-        self.state = [t.MachineState()]
+        self.machine = t.MachineState(self.config)
+        self.history = t.History(self.machine)
+        self.view = self.machine
         self.playing = False
         self.loaded = False
         self.halted = False
@@ -243,6 +352,7 @@ class GUI:
     def reset(self):
         self.playing = False
         self.current = 0
+        self.view = self.history.seek(self.current)
         self.redraw()
 
     def update_button(self):
@@ -260,7 +370,7 @@ class GUI:
             buttons["pause"]["state"] = "normal"
             buttons["auto"]["state"] = "disabled"
 
-        if self.halted and self.current == len(self.state) - 1:
+        if self.halted and self.current == len(self.history) - 1:
             buttons["next"]["state"] = "disabled"
         else:
             buttons["next"]["state"] = "normal"
@@ -270,29 +380,26 @@ class GUI:
             buttons["prev"]["state"] = "normal"
 
     def update(self):
-        new_state = self.state[-1].copy()
-        self.halted = new_state.nextStep()
+        self.halted = self.machine.nextStep()
         if self.halted:
             msg.showinfo("halted", "Halted")
-        self.state.append(new_state)
+        self.history.record(self.machine)
 
-    def load_by(self, f: Callable[[str], tuple[list[str], list[bytes]]]):
+    def load_by(self, f: Callable[["t.MachineState", str], tuple[list[str], int]]):
         self.init()
         path = fdl.askopenfilename()
         if not path:
             return
+        init = self.machine
         try:
-            self.asm, b = f(path)
+            self.asm, size = f(init, path)
         except Exception as e:
             msg.showerror(type(e).__name__, " ".join(map(str, e.args)))
             return
-        init = self.state[0]
-        pc = init.pc
-        for instr in b:
-            init.loadInstr(pc, instr)
-            pc += 1
+        pc = init.pc + size
         self.memsize = pc
-        init.setMemorySize(pc)
+        self.history = t.History(init)
+        self.view = self.history.current()
         self.loaded = True
         self.mem_sheet.row_index([i for i in range(pc)])
         self.redraw()
@@ -300,13 +407,15 @@ class GUI:
     def prev(self):
         if self.loaded:
             self.current -= 1
+            self.view = self.history.stepBack()
             self.redraw()
 
     def next(self):
         if self.loaded:
             self.current += 1
-            if self.current == len(self.state):
+            if self.current == len(self.history):
                 self.update()
+            self.view = self.history.seek(self.current)
             self.redraw()
 
     def autoplay(self):
@@ -322,85 +431,13 @@ class GUI:
     def tick(self):
         if self.loaded:
             if self.playing:
-                if not self.halted or self.current != len(self.state) - 1:
+                if not self.halted or self.current != len(self.history) - 1:
                     self.next()
                 else:
                     self.playing = False
                     self.update_button()
         self.window.after(self.autospeed, self.tick)
 
-    @property
-    def current_state(self):
-        return self.state[self.current]
-
-    @property
-    def current_pc(self):
-        return f"PC: {self.current_state.pc}"
-
-    @property
-    def current_cycle(self):
-        return f"Cycles: {self.current_state.cycles}"
-
-    @property
-    def current_reg(self):
-        state = self.current_state
-        return [
-            (reg, result.valid, result.robIdx)
-            for reg, result in zip(state.regFile, state.regResult)
-        ]
-
-    @property
-    def current_memory(self):
-        state = self.current_state
-        return [(word,) for word in state.memory[: self.memsize]]
-
-    @property
-    def current_rob(self):
-        state = self.current_state
-        return [
-            (
-                entry.busy,
-                entry.valid,
-                entry.pc,
-                entry.instr,
-                instr_state[entry.instrStatus],
-                units[entry.execUnit],
-                entry.result,
-                entry.address,
-            )
-            for entry in state.rob
-        ]
-
-    @property
-    def current_reserv(self):
-        state = self.current_state
-        return [
-            (
-                entry.busy,
-                entry.instr,
-                entry.Vj,
-                entry.Vk,
-                units[entry.Qj],
-                units[entry.Qk],
-                entry.exTimeLeft,
-                entry.robIdx,
-            )
-            for entry in state.reservation[1:]
-        ]
-
-    @property
-    def current_btb(self):
-        state = self.current_state
-        return [
-            (
-                entry.valid,
-                entry.branchPc,
-                entry.targetPc,
-                entry.branchPred.name,
-            )
-            for entry in state.btb
-        ]
-
     def redraw(self):
         # t.printState(self.current_state, self.memsize)
         self.update_button()
@@ -443,5 +480,22 @@ if __name__ == "__main__":
         nargs="?",
         help="speed of auto-playing in ms",
     )
+    parser.add_argument(
+        "--config",
+        type=str,
+        default=None,
+        help="machine configuration file, see `MachineConfig`",
+    )
+    parser.add_argument(
+        "--check",
+        type=str,
+        default=None,
+        metavar="ASM",
+        help="run ASM without a window, building every table on every cycle, then exit",
+    )
     args = parser.parse_args()
-    gui = GUI(args.play_speed)
+    config = t.MachineConfig.fromFile(args.config) if args.config else None
+    if args.check:
+        print(f"{args.check}: {check(args.check, config)} cycles OK")
+        sys.exit(0)
+    gui = GUI(args.play_speed, config)
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "decode.hpp"
+#include "defines.hpp"
+#include "error.hpp"
+
+/*
+ * 与 `scripts/assembler.py` 相同语法的汇编器:
+ *   [label] op arg, arg, ...    ; 注释
+ * 行首不是指令名的单词视为标号, 标号可以单独占一行, 此时指向下一条指令.
+ * 标号区分大小写, 指令名不区分.
+ * 空行与只有注释的行被忽略. I 型指令写作 `op rd, rs1, imm`, R 型写作 `op rd, rs1, rs2`,
+ * `beqz rs1, label`, `j label`, `halt` 与 `noop` 没有操作数.
+ * 出错时抛出 TomasuloError, 消息以 `source:行号:` 开头.
+ */
+class Assembler {
+  public:
+    static std::vector<word> assemble(std::string_view text, const std::string& source = "<string>") {
+        Assembler as{source};
+        as.words.reserve(text.size() / 16);
+        word lineno = 1;
+        for (size_t begin = 0; begin < text.size(); ++lineno) {
+            auto end = text.find('\n', begin);
+            if (end == std::string_view::npos)
+                end = text.size();
+            as.line(text.substr(begin, end - begin), lineno);
+            begin = end + 1;
+        }
+        as.resolve();
+        return std::move(as.words);
+    }
+
+  private:
+    enum Format { FMT_I, FMT_R, FMT_BRANCH, FMT_JUMP, FMT_NONE };
+
+    struct OpInfo {
+        const char* name;
+        word op;
+        word funccode;
+        Format format;
+    };
+
+    static constexpr OpInfo OPS[] = {
+        {"lw", LW, 0, FMT_I},
+        {"sw", SW, 0, FMT_I},
+        {"add", RR_ALU, FUNC_ADD, FMT_R},
+        {"addi", ADDI, 0, FMT_I},
+        {"sub", RR_ALU, FUNC_SUB, FMT_R},
+        {"and", RR_ALU, FUNC_AND, FMT_R},
+        {"andi", ANDI, 0, FMT_I},
+        {"beqz", BEQZ, 0, FMT_BRANCH},
+        {"j", J, 0, FMT_JUMP},
+        {"halt", HALT, 0, FMT_NONE},
+        {"noop", NOOP, 0, FMT_NONE},
+    };
+
+    struct Label {             /* 标号定义 */
+        std::string_view name; /* 指向原文 */
+        word index;            /* 所指指令的下标 */
+        word lineno;
+    };
+
+    struct Fixup {              /* 等待标号地址的跳转指令 */
+        word index;             /* 指令在程序中的下标 */
+        word lineno;            /* 所在行号, 用于报错 */
+        std::string_view label;
+    };
+
+    const std::string& source;
+    std::vector<word> words{};
+    std::vector<Label> labels{}; /* 按出现顺序 */
+    std::vector<Fixup> fixups{};
+
+    explicit Assembler(const std::string& source) : source(source) {
+    }
+
+    template <class... Args> [[noreturn]] void fail(word lineno, Args&&... args) const {
+        throw TomasuloError(source + ":" + std::to_string(lineno) + ":", std::forward<Args>(args)...);
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    static std::string_view nextToken(std::string_view& rest) {
+        //* 取出 `rest` 开头的一个单词
+        size_t begin = 0;
+        while (begin < rest.size() && isSpace(rest[begin]))
+            ++begin;
+        size_t end = begin;
+        while (end < rest.size() && !isSpace(rest[end]))
+            ++end;
+        auto token = rest.substr(begin, end - begin);
+        rest.remove_prefix(end);
+        return token;
+    }
+
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && isSpace(text.front()))
+            text.remove_prefix(1);
+        while (!text.empty() && isSpace(text.back()))
+            text.remove_suffix(1);
+        return text;
+    }
+
+    static const OpInfo* findOp(std::string_view token) {
+        //* 指令名不区分大小写
+        if (token.size() > 4)
+            return nullptr;
+        char lower[4];
+        for (size_t i = 0; i < token.size(); i++)
+            lower[i] = (char)std::tolower((unsigned char)token[i]);
+        std::string_view name(lower, token.size());
+        for (auto& info : OPS) {
+            if (name == info.name)
+                return &info;
+        }
+        return nullptr;
+    }
+
+    void line(std::string_view text, word lineno) {
+        auto comment = text.find(';');
+        if (comment != std::string_view::npos)
+            text = text.substr(0, comment);
+        auto token = nextToken(text);
+        if (token.empty())
+            return;
+        auto info = findOp(token);
+        if (info == nullptr) {
+            labels.push_back({token, (word)words.size(), lineno});
+            token = nextToken(text);
+            if (token.empty())
+                return;
+            info = findOp(token);
+            if (info == nullptr)
+                fail(lineno, "unknown instruction", token);
+        }
+
+        // 操作数以逗号分隔, 两侧的空白被忽略
+        std::string_view args[3];
+        size_t count = 0;
+        if (!trim(text).empty()) {
+            while (true) {
+                auto comma = text.find(',');
+                if (count == 3)
+                    fail(lineno, "too many operands for", info->name);
+                args[count++] = trim(text.substr(0, comma));
+                if (comma == std::string_view::npos)
+                    break;
+                text.remove_prefix(comma + 1);
+            }
+        }
+
+        static constexpr size_t arity[] = {3, 3, 2, 1, 0};
+        if (count != arity[info->format])
+            fail(lineno, info->name, "expects", arity[info->format], "operands, got", count);
+
+        auto index = (word)words.size();
+        switch (info->format) {
+        case FMT_I:
+            words.push_back(encodeI(info->op, reg(args[1], lineno), reg(args[0], lineno), imm(args[2], lineno)));
+            break;
+        case FMT_R:
+            words.push_back(encodeR(reg(args[1], lineno), reg(args[2], lineno), reg(args[0], lineno), info->funccode));
+            break;
+        case FMT_BRANCH:
+            words.push_back(encodeI(info->op, reg(args[0], lineno), 0, 0));
+            fixups.push_back({index, lineno, label(args[1], lineno)});
+            break;
+        case FMT_JUMP:
+            words.push_back(encodeJ(info->op, 0));
+            fixups.push_back({index, lineno, label(args[0], lineno)});
+            break;
+        case FMT_NONE:
+            words.push_back(encodeJ(info->op, 0));
+            break;
+        }
+    }
+
+    word reg(std::string_view arg, word lineno) const {
+        word value = 0;
+        if (arg.size() < 2 || (arg[0] != 'r' && arg[0] != 'R'))
+            fail(lineno, "invalid register", arg);
+        auto [end, ec] = std::from_chars(arg.data() + 1, arg.data() + arg.size(), value);
+        if (ec != std::errc() || end != arg.data() + arg.size() || value >= NUMREGS)
+            fail(lineno, "invalid register", arg);
+        return value;
+    }
+
+    word imm(std::string_view arg, word lineno) const {
+        //* 立即数为十进制, 可以是有符号或无符号的 16 位数
+        int64_t value = 0;
+        auto digits = arg.substr(!arg.empty() && arg[0] == '+' ? 1 : 0);
+        if (digits.empty() || (digits.size() < arg.size() && digits[0] == '-'))
+            fail(lineno, "invalid immediate", arg);
+        auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        if (ec != std::errc() || end != digits.data() + digits.size())
+            fail(lineno, "invalid immediate", arg);
+        if (value < INT16_MIN || value > UINT16_MAX)
+            fail(lineno, "immediate", arg, "does not fit in 16 bits");
+        return (word)value;
+    }
+
+    std::string_view label(std::string_view arg, word lineno) const {
+        if (arg.empty())
+            fail(lineno, "missing label");
+        return arg;
+    }
+
+    static uint64_t hash(std::string_view name) {
+        //* FNV-1a
+        uint64_t h = 14695981039346656037ull;
+        for (char c : name)
+            h = (h ^ (unsigned char)c) * 1099511628211ull;
+        return h;
+    }
+
+    void resolve() {
+        /*
+         * 所有标号都已知道后填写跳转偏移.
+         * 标号数此时已知, 一次建好开放寻址的散列表, 槽中存放 `labels` 的下标加 1, 0 为空槽.
+         */
+        size_t capacity = 16;
+        while (capacity < labels.size() * 2)
+            capacity *= 2;
+        std::vector<word> slots(capacity);
+        auto find = [&](std::string_view name) {
+            auto slot = hash(name) & (capacity - 1);
+            while (slots[slot] != 0 && labels[slots[slot] - 1].name != name)
+                slot = (slot + 1) & (capacity - 1);
+            return slot;
+        };
+        for (word i = 0; i < labels.size(); i++) {
+            auto slot = find(labels[i].name);
+            if (slots[slot] != 0)
+                fail(labels[i].lineno, "duplicate label", labels[i].name);
+            slots[slot] = i + 1;
+        }
+        for (auto& fixup : fixups) {
+            auto slot = find(fixup.label);
+            if (slots[slot] == 0)
+                fail(fixup.lineno, "undefined label", fixup.label);
+            auto& target = labels[slots[slot] - 1];
+            auto offset = int64_t(target.index) - int64_t(fixup.index) - 1;
+            auto& instr = words[fixup.index];
+            if (opcode(instr) == BEQZ) {
+                if (offset < INT16_MIN || offset > INT16_MAX)
+                    fail(fixup.lineno, "branch to", fixup.label, "is out of range");
+                instr |= (word)offset & maskN(16);
+            } else {
+                if (offset < -(int64_t(1) << 25) || offset >= (int64_t(1) << 25))
+                    fail(fixup.lineno, "jump to", fixup.label, "is out of range");
+                instr |= (word)offset & maskN(26);
+            }
+        }
+    }
+};
@@ -0,0 +1,785 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "defines.hpp"
+#include "error.hpp"
+#include "state.hpp"
+#include "sweep.hpp"
+
+/*
+ * 同一程序的多个实例锁步推进, 用于蒙特卡洛实验与参数研究:
+ * 各实例可以有不同的寄存器与内存初值, `run(n)` 使每个未停机的实例各前进 n 个周期.
+ *
+ * 控制状态 (ROB 与保留栈的占用, 寄存器状态, 分支预测器, 缓存, 统计等) 相同的实例组成一组,
+ * 组内共用一份 `MachineState` 作为骨架, 每周期只推进一次; 数据 (操作数与结果) 按实例分列存放,
+ * 发射, 写回与提交时对组内各列逐一处理. 数据只在三处影响控制: 分支的方向, load/store 的地址,
+ * 以及取到被改写过的代码. 到达这些位置时, 组内取值不同的实例按取值拆成新组, 从同一位置继续本周期,
+ * 所以每个实例的结果都与单独运行的 `MachineState` 完全相同. 拆开的组不再合并.
+ * 只有数据初值不同的实例在分支与地址上分歧之前一直同组, 推进一组的开销接近推进单个实例;
+ * 完全分歧时退化为逐个推进. 各组相互独立, 组足够多时在线程池上并行.
+ *
+ * 寄存器与计数器以实例为主序汇总在连续的表中, 第 i 个实例占第 i 行, 供 numpy 直接查看;
+ * 寄存器表即各实例的寄存器本身, 推进之间修改它即修改寄存器. 内存每个实例一份, 写时复制地共享页面.
+ * 停机的实例不再推进; 也可以用 `setRunning` 手动屏蔽, 屏蔽的实例单独拆为一组.
+ */
+constexpr uint64_t BATCH_PARALLEL_WORK = 1024; /* 一次推进的总周期数 (实例数 × 周期数) 达到此值才使用线程池 */
+
+class MachineBatch {
+  public:
+    std::vector<word> regs{};          /* 寄存器表, 第 i 个实例的寄存器在 [i * NUMREGS, (i + 1) * NUMREGS) */
+    std::vector<word> pcs{};           /* 各实例的 PC */
+    std::vector<uint64_t> cycles{};    /* 各实例经过的周期数 */
+    std::vector<uint64_t> committed{}; /* 各实例提交的指令数 */
+    std::vector<uint8_t> halted{};     /* 各实例是否已停机 */
+
+    MachineBatch(const MachineState& program, word count, unsigned threads = 0)
+        : regs((size_t)count * NUMREGS), pcs(count), cycles(count), committed(count), halted(count),
+          memories(count, program.memory), paused(count), location(count), threads(threads) {
+        std::vector<word> members(count);
+        for (word i = 0; i < count; i++) {
+            members[i] = i;
+            std::copy(program.regFile.begin(), program.regFile.end(), &regs[i * NUMREGS]);
+        }
+        if (count != 0)
+            groups.emplace_back(program, std::move(members));
+        locate();
+        gather();
+    }
+
+    word size() const {
+        return (word)memories.size();
+    }
+
+    word numGroups() const {
+        //* 当前的组数, 即每周期实际推进的控制状态的份数
+        return (word)groups.size();
+    }
+
+    MachineState instance(word i) const {
+        //* 第 `i` 个实例的完整状态, 由所在组的控制状态与该实例的数据拼成; 返回的是副本
+        check(i);
+        const auto& group = groups[location[i].first];
+        auto k = location[i].second;
+        auto width = group.width();
+        MachineState state{group.skel};
+        for (word unit = 0; unit < state.reservation.size(); unit++) {
+            if (state.reservation[unit].busy) {
+                state.reservation[unit].Vj = group.vj[unit * width + k];
+                state.reservation[unit].Vk = group.vk[unit * width + k];
+            }
+        }
+        for (word idx = 0; idx < state.rob.size(); idx++)
+            if (state.rob[idx].valid)
+                state.rob[idx].result = group.result[idx * width + k];
+        std::copy_n(&regs[i * NUMREGS], NUMREGS, state.regFile.begin());
+        state.memory = memories[i];
+        return state;
+    }
+
+    void setInstance(word i, const MachineState& state) {
+        //* 以 `state` 替换第 `i` 个实例, 它单独成为一组; 机器参数须与批中的相同
+        check(i);
+        if (state.config != groups[location[i].first].skel.config)
+            throw TomasuloError("Instance must use the configuration of the batch");
+        auto g = detach(i);
+        auto wasPaused = groups[g].paused;
+        groups[g] = LaneGroup(state, {i});
+        groups[g].paused = wasPaused;
+        std::copy(state.regFile.begin(), state.regFile.end(), &regs[i * NUMREGS]);
+        memories[i] = state.memory;
+        gather();
+    }
+
+    std::vector<word> readMemory(word i, word address, word count) const {
+        //* 读取第 `i` 个实例从 `address` 开始的 `count` 个字
+        check(i);
+        if (address + uint64_t(count) > memories[i].size())
+            throw TomasuloError("Range", address, "+", count, "is out of memory");
+        std::vector<word> values(count);
+        memories[i].readRange(address, values.data(), count);
+        return values;
+    }
+
+    void writeMemory(word i, word address, const word* values, word count) {
+        //* 改写第 `i` 个实例的一段内存; 改写代码时组内的代码可能不再相同, 此后取指需逐个比较
+        check(i);
+        if (address + uint64_t(count) > memories[i].size())
+            throw TomasuloError("Range", address, "+", count, "is out of memory");
+        memories[i].writeRange(address, values, count);
+        auto& group = groups[location[i].first];
+        if (location[i].second == 0)
+            group.skel.invalidateUops(address, count);
+        if (group.width() > 1)
+            for (auto a = address; a < std::min<uint64_t>(uint64_t(address) + count, group.skel.memorySize); a++)
+                group.markCode(a, true);
+    }
+
+    bool isRunning(word i) const {
+        return i < size() && !halted[i] && !paused[i];
+    }
+
+    void setRunning(word i, bool on) {
+        //* 屏蔽或恢复第 `i` 个实例, 已停机的实例不能恢复; 屏蔽的实例从所在的组中拆出
+        check(i);
+        if (paused[i] == !on)
+            return;
+        paused[i] = !on;
+        groups[detach(i)].paused = !on;
+    }
+
+    word numRunning() const {
+        word n = 0;
+        for (word i = 0; i < size(); i++)
+            n += isRunning(i);
+        return n;
+    }
+
+    bool step() {
+        //* 所有未屏蔽的实例前进一个周期, 返回是否都已停止; 组足够多时同样使用线程池
+        return run(1);
+    }
+
+    bool run(uint64_t maxCycles) {
+        /*
+         * 所有未屏蔽的实例各前进 `maxCycles` 个周期或直到停机, 返回是否都已停止.
+         * 组之间相互独立, 所以各组连续地运行自己的周期, 本次拆出的组也在同一任务中接着推进.
+         * 某组出错时停在出错的周期, 其余的组照常推进, 之后再抛出第一个错误.
+         * 每组为线程池的一个任务; 总工作量很小时不值得创建线程.
+         * 工作量以除法比较, 避免 `maxCycles` 很大 (例如 UINT64_MAX) 时乘法溢出.
+         */
+        auto workers = numRunning() >= BATCH_PARALLEL_WORK / std::max<uint64_t>(maxCycles, 1) ? threads : 1;
+        auto count = groups.size();
+        std::vector<std::vector<LaneGroup>> spawned(count);
+        std::vector<std::exception_ptr> errors(count);
+        parallelFor(count, workers, [&](size_t g) {
+            std::vector<Pending> pending{};
+            auto guarded = [&](LaneGroup& group, const Resume& at, uint64_t left) {
+                try {
+                    advance(group, at, left, pending);
+                } catch (...) {
+                    if (!errors[g])
+                        errors[g] = std::current_exception();
+                }
+            };
+            guarded(groups[g], {}, maxCycles);
+            while (!pending.empty()) {
+                auto at = pending.back().at;
+                auto left = pending.back().cycles;
+                spawned[g].push_back(std::move(pending.back().group));
+                pending.pop_back();
+                guarded(spawned[g].back(), at, left);
+            }
+        });
+        for (auto& list : spawned)
+            for (auto& group : list)
+                groups.push_back(std::move(group));
+        locate();
+        gather();
+        for (auto& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+        return numRunning() == 0;
+    }
+
+    void gather() {
+        //* 从各组重新汇总计数器表
+        for (const auto& group : groups) {
+            for (auto i : group.lanes) {
+                pcs[i] = group.skel.pc;
+                cycles[i] = group.skel.cycles;
+                committed[i] = group.skel.stats.committed;
+                halted[i] = group.halted;
+            }
+        }
+    }
+
+    std::vector<double> counter(const std::string& name) const {
+        //* 各实例名为 `name` 的计数器, 名称与 `MachineState.stats()` 相同
+        std::vector<double> values(size());
+        bool found = false;
+        for (const auto& group : groups) {
+            visitCounters(group.skel, [&](const char* key, auto value) {
+                if (name == key) {
+                    for (auto i : group.lanes)
+                        values[i] = (double)value;
+                    found = true;
+                }
+            });
+            if (!found)
+                throw TomasuloError("Unknown counter", name);
+        }
+        return values;
+    }
+
+  private:
+    enum Phase { PHASE_START, PHASE_COMMIT, PHASE_WRITEBACK, PHASE_ISSUE };
+
+    struct Resume {                   /* 周期中拆出的组从这里继续 */
+        Phase phase = PHASE_START;    /* PHASE_START 即从头开始一个新周期 */
+        word index = 0;               /* 提交槽, 写回顺序或发射槽的下标 */
+        word cdbLeft = 0;             /* 以下只用于写回阶段: 剩余的公共数据总线 */
+        word count = 0;               /* 本周期按先后顺序排列的保留栈 */
+        std::array<word, 64> order{};
+    };
+
+    struct LaneGroup {
+        MachineState skel;            /* 组内共同的控制状态, 其中的操作数, 结果, 寄存器与内存不使用 */
+        std::vector<word> lanes;      /* 组内的实例编号, 即各数据列所属的实例 */
+        std::vector<word> vj;         /* 保留栈的操作数, 第 unit 行的第 k 列属于实例 lanes[k] */
+        std::vector<word> vk;
+        std::vector<word> result;     /* ROB 项的结果, 第 robIdx 行 */
+        std::vector<word> values{};   /* 写回时各列的结果 */
+        std::vector<uint8_t> mixed{}; /* 代码中组内各实例可能不同的字, 取到时需逐个比较; 为空即代码都相同 */
+        bool halted = false;
+        bool paused = false;
+
+        LaneGroup(const MachineState& state, std::vector<word> members)
+            : skel(state), lanes(std::move(members)), vj(state.reservation.size() * lanes.size()),
+              vk(vj.size()), result(state.rob.size() * lanes.size()) {
+            skel.memory = PagedMemory(state.config);
+            auto width = lanes.size();
+            for (size_t unit = 0; unit < state.reservation.size(); unit++) {
+                std::fill_n(&vj[unit * width], width, state.reservation[unit].Vj);
+                std::fill_n(&vk[unit * width], width, state.reservation[unit].Vk);
+            }
+            for (size_t idx = 0; idx < state.rob.size(); idx++)
+                std::fill_n(&result[idx * width], width, state.rob[idx].result);
+        }
+
+        LaneGroup(const LaneGroup& from, const std::vector<size_t>& cols)
+            : skel(from.skel), lanes(select(from.lanes, from.width(), cols)), vj(select(from.vj, from.width(), cols)),
+              vk(select(from.vk, from.width(), cols)), result(select(from.result, from.width(), cols)),
+              mixed(from.mixed), halted(from.halted), paused(from.paused) {
+            if (cols[0] != 0)
+                invalidateMixed();
+        }
+
+        size_t width() const {
+            return lanes.size();
+        }
+
+        void keep(const std::vector<size_t>& cols) {
+            //* 只保留 `cols` 中的列
+            auto width = this->width();
+            vj = select(vj, width, cols);
+            vk = select(vk, width, cols);
+            result = select(result, width, cols);
+            lanes = select(lanes, width, cols);
+            if (cols[0] != 0)
+                invalidateMixed();
+        }
+
+        void markCode(word address, bool differs) {
+            //* 记录代码中的一个字在组内是否可能不同
+            if (differs && mixed.size() <= address)
+                mixed.resize(skel.memorySize);
+            if (address < mixed.size())
+                mixed[address] = differs;
+        }
+
+        bool mixedAt(word pc) const {
+            return pc < mixed.size() && mixed[pc];
+        }
+
+        void invalidateMixed() {
+            //* 第一列换成了别的实例, 预译码缓存中可能不同的字需按新的第一列重新译码
+            for (word a = 0; a < mixed.size(); a++)
+                if (mixed[a])
+                    skel.invalidateUops(a, 1);
+        }
+
+        static std::vector<word> select(const std::vector<word>& table, size_t width, const std::vector<size_t>& cols) {
+            //* 每行 `width` 列的表中选出 `cols` 各列
+            auto rows = table.size() / width;
+            std::vector<word> out(rows * cols.size());
+            for (size_t r = 0; r < rows; r++)
+                for (size_t j = 0; j < cols.size(); j++)
+                    out[r * cols.size() + j] = table[r * width + cols[j]];
+            return out;
+        }
+    };
+
+    struct Pending {    /* 本周期拆出, 尚未推进的组 */
+        LaneGroup group;
+        Resume at;
+        uint64_t cycles; /* 还需推进的周期数, 含正在进行的周期 */
+    };
+
+    std::vector<PagedMemory> memories{};            /* 各实例的内存 */
+    std::vector<uint8_t> paused{};                  /* 各实例是否被屏蔽 */
+    std::vector<LaneGroup> groups{};
+    std::vector<std::pair<size_t, word>> location{}; /* 各实例所在的组与列 */
+    unsigned threads;                               /* 线程池大小, 0 为核数 */
+
+    void check(word i) const {
+        if (i >= size())
+            throw TomasuloError("Instance", i, "is out of range");
+    }
+
+    void locate() {
+        for (size_t g = 0; g < groups.size(); g++)
+            for (word k = 0; k < groups[g].width(); k++)
+                location[groups[g].lanes[k]] = {g, k};
+    }
+
+    size_t detach(word i) {
+        //* 把第 `i` 个实例拆为单独的一组, 返回组的下标
+        auto g = location[i].first;
+        auto k = location[i].second;
+        if (groups[g].width() == 1)
+            return g;
+        std::vector<size_t> rest{};
+        for (size_t c = 0; c < groups[g].width(); c++)
+            if (c != k)
+                rest.push_back(c);
+        LaneGroup alone(groups[g], {k});
+        groups[g].keep(rest);
+        groups.push_back(std::move(alone));
+        locate();
+        return groups.size() - 1;
+    }
+
+    void advance(LaneGroup& group, Resume at, uint64_t maxCycles, std::vector<Pending>& pending) {
+        //* 推进一组 `maxCycles` 个周期或直到停机, 从 `at` 继续的周期也计入其中
+        if (group.halted || group.paused)
+            return;
+        for (uint64_t c = 0; c < maxCycles; c++, at = {}) {
+            if (cycle(group, at, maxCycles - c, pending)) {
+                group.halted = true;
+                break;
+            }
+        }
+    }
+
+    template <class Key>
+    void diverge(LaneGroup& group, const Resume& here, uint64_t left, std::vector<Pending>& pending, Key&& key) {
+        /*
+         * 在由数据决定控制的位置上检查组内各列的取值 `key(k)`:
+         * 与第一列相同的留在本组, 其余按取值各拆出一组, 加入 `pending` 并从 `here` 继续本周期.
+         */
+        auto width = group.width();
+        auto first = key(0);
+        size_t k = 1;
+        while (k < width && key(k) == first)
+            k++;
+        if (k == width)
+            return;
+        std::vector<uint64_t> keys(width);
+        for (k = 0; k < width; k++)
+            keys[k] = key(k);
+        std::vector<uint8_t> taken(width);
+        std::vector<size_t> same{};
+        for (k = 0; k < width; k++) {
+            if (keys[k] == first) {
+                same.push_back(k);
+            } else if (!taken[k]) {
+                std::vector<size_t> cols{};
+                for (auto j = k; j < width; j++) {
+                    if (keys[j] == keys[k]) {
+                        cols.push_back(j);
+                        taken[j] = 1;
+                    }
+                }
+                pending.push_back({LaneGroup(group, cols), here, left});
+            }
+        }
+        group.keep(same);
+    }
+
+    bool cycle(LaneGroup& group, Resume at, uint64_t left, std::vector<Pending>& pending) {
+        /*
+         * 一组前进一个周期, 与 `MachineState::nextStep` 逐段对应, 只是数据按列处理.
+         * 由数据决定控制的位置先经 `diverge` 检查, 不一致的列拆出之后本组的各列取值相同, 控制仍只走一遍.
+         */
+        auto& s = group.skel;
+        const auto& config = s.config;
+        if (at.phase == PHASE_START) {
+            s.cycles += 1;
+            at.phase = PHASE_COMMIT;
+        }
+
+        // committing
+        if (at.phase == PHASE_COMMIT) {
+            for (auto i = at.index; i < config.commitWidth; ++i) {
+                auto head = s.robHead();
+                if (head == (size_t)-1)
+                    break;
+                const auto& robEntry = s.rob[head];
+                if (!robEntry.busy || !robEntry.valid || robEntry.instrStatus != COMMITTING)
+                    break;
+                if (robEntry.uop.op == HALT) {
+                    s.retire(head);
+                    s.robPop();
+                    return true;
+                }
+                if (OPTRAITS[robEntry.uop.op].control == CTRL_BRANCH) {
+                    at.index = i;
+                    diverge(group, at, left, pending,
+                            [&](size_t k) { return uint64_t(group.result[head * group.width() + k] == 0); });
+                }
+                commitLanes(group, (word)head);
+                if (s.robHeadIdx == head)
+                    break;
+            }
+
+            // processing
+            for (auto robIdx : s.written) {
+                s.rob[robIdx].instrStatus = COMMITTING;
+            }
+            s.written.clear();
+            at.phase = PHASE_WRITEBACK;
+            at.index = 0;
+            at.cdbLeft = config.numCDB;
+            at.count = 0;
+            for (auto mask = s.activeMask; mask; mask &= mask - 1) {
+                word unit = __builtin_ctzll(mask);
+                auto age = s.robAge(s.reservation[unit].robIdx);
+                auto pos = at.count++;
+                for (; pos > 0 && s.robAge(s.reservation[at.order[pos - 1]].robIdx) > age; --pos) {
+                    at.order[pos] = at.order[pos - 1];
+                }
+                at.order[pos] = unit;
+            }
+        }
+
+        if (at.phase == PHASE_WRITEBACK) {
+            for (auto i = at.index; i < at.count; ++i) {
+                auto unit = at.order[i];
+                if (!(s.activeMask & MachineState::bit(unit)))
+                    continue;
+                auto& reserv = s.reservation[unit];
+                auto& robEntry = s.rob[reserv.robIdx];
+                auto op = reserv.uop.op;
+
+                // 先按本次处理会用到的数据拆组: load/store 的地址, 写回时恢复的分支方向
+                auto finishing = robEntry.instrStatus == EXECUTING && reserv.exTimeLeft == 0;
+                auto writing = (finishing || robEntry.instrStatus == WRITING_RESULT) && at.cdbLeft != 0;
+                auto starting = robEntry.instrStatus == ISSUING && reserv.Qj == READY && reserv.Qk == READY;
+                at.index = i;
+                if ((op == LW && (writing || (starting && s.cache.enabled()))) || (op == SW && finishing)) {
+                    diverge(group, at, left, pending,
+                            [&](size_t k) { return uint64_t(group.vj[unit * group.width() + k] + reserv.uop.imm); });
+                } else if (op == BEQZ && writing && config.branchRecovery == WRITEBACK) {
+                    diverge(group, at, left, pending,
+                            [&](size_t k) { return uint64_t(group.vj[unit * group.width() + k] == 0); });
+                }
+
+                auto width = group.width();
+                if (robEntry.instrStatus == EXECUTING) {
+                    if (reserv.exTimeLeft != 0)
+                        reserv.exTimeLeft -= 1;
+                    else {
+                        robEntry.instrStatus = WRITING_RESULT;
+                        if (op == SW) {
+                            robEntry.address = group.vj[unit * width] + reserv.uop.imm;
+                        }
+                        if (at.cdbLeft != 0) {
+                            writeLanes(group, unit);
+                            at.cdbLeft -= 1;
+                        } else if constexpr (COUNTERS) {
+                            s.stats.cdbConflicts += 1;
+                        }
+                    }
+                } else if (robEntry.instrStatus == WRITING_RESULT) {
+                    if (at.cdbLeft != 0) {
+                        writeLanes(group, unit);
+                        at.cdbLeft -= 1;
+                    } else if constexpr (COUNTERS) {
+                        s.stats.cdbConflicts += 1;
+                    }
+                } else if (starting) {
+                    robEntry.instrStatus = EXECUTING;
+                    if (s.cache.enabled() && op == LW)
+                        reserv.exTimeLeft = s.loadLatency(group.vj[unit * width] + reserv.uop.imm);
+                    reserv.exTimeLeft -= 1;
+                }
+            }
+        }
+
+        // issuing
+        if (at.phase != PHASE_ISSUE && s.fetchStall != 0) {
+            s.fetchStall -= 1;
+        } else {
+            for (auto i = at.phase == PHASE_ISSUE ? at.index : 0; i < config.issueWidth; ++i) {
+                if (group.mixedAt(s.pc)) {
+                    auto pc = s.pc;
+                    at.phase = PHASE_ISSUE;
+                    at.index = i;
+                    diverge(group, at, left, pending, [&](size_t k) { return uint64_t(memories[group.lanes[k]][pc]); });
+                }
+                if (!issueLanes(group))
+                    break;
+            }
+        }
+
+        if constexpr (COUNTERS) {
+            s.robOccupancy[s.robAge(s.robTailIdx)] += 1;
+            for (auto mask = s.activeMask; mask; mask &= mask - 1)
+                s.unitBusy[__builtin_ctzll(mask)] += 1;
+            for (auto unit = config.firstStore(); unit < config.firstInt(); ++unit)
+                s.unitBusy[unit] += s.reservation[unit].busy;
+        }
+        return false;
+    }
+
+    void readLanes(LaneGroup& group, OperandKind kind, word pc, word unit, word* V, word& Q) {
+        //* 同 `readSource`: 操作数的来源由控制状态决定, 各列只是取值不同; 等待的操作数为 0
+        auto& s = group.skel;
+        auto width = group.width();
+        const auto& uop = s.reservation[unit].uop;
+        if (kind != OPND_RS1 && kind != OPND_RS2) {
+            Q = READY;
+            std::fill_n(V, width, kind == OPND_NEXTPC ? pc + 1 : 0);
+            return;
+        }
+        auto reg = kind == OPND_RS1 ? uop.rs1 : uop.rs2;
+        const auto& rg = s.regResult[reg];
+        if (rg.valid) {
+            Q = READY;
+            for (size_t k = 0; k < width; k++)
+                V[k] = regs[group.lanes[k] * NUMREGS + reg];
+            return;
+        }
+        const auto& rgRob = s.rob[rg.robIdx];
+        if (rgRob.valid) {
+            Q = READY;
+            std::copy_n(&group.result[rg.robIdx * width], width, V);
+        } else {
+            Q = rgRob.execUnit;
+            s.waiters[Q] |= MachineState::bit(unit);
+            std::fill_n(V, width, 0);
+        }
+    }
+
+    bool issueLanes(LaneGroup& group) {
+        //* 同 `MachineState::issueNext`, 源操作数按列读取; 代码取自组内第一个实例的内存
+        auto& s = group.skel;
+        const auto& config = s.config;
+        if (s.pc >= s.memorySize)
+            return false;
+        auto pc = s.pc;
+        const auto& code = memories[group.lanes[0]];
+        const auto& traits = OPTRAITS[s.fetchUop(pc, code).op];
+        if (!traits.valid)
+            throw TomasuloError("Invalid instruction", code[pc], "at pc=", pc);
+        auto load = traits.unit == UNIT_LOAD;
+        auto first = load ? config.firstLoad() : config.firstInt();
+        auto last = load ? config.firstStore() : config.numUnits() + 1;
+        word unit = INVALID;
+        for (auto idx = first; idx < last; ++idx) {
+            if (!s.reservation[idx].busy) {
+                unit = idx;
+                break;
+            }
+        }
+
+        if (unit == INVALID) {
+            s.stats.stalls += 1;
+            if constexpr (COUNTERS)
+                s.stats.stallsNoStation += 1;
+            return false;
+        }
+        auto robIdx = s.robPush();
+        if (robIdx == (size_t)-1) {
+            s.stats.stalls += 1;
+            if constexpr (COUNTERS)
+                s.stats.stallsRobFull += 1;
+            return false;
+        }
+
+        auto& reservEntry = s.reservation[unit];
+        auto& robEntry = s.rob[robIdx];
+        reservEntry.busy = true;
+        reservEntry.robIdx = (word)robIdx;
+        reservEntry.instr = code[pc];
+        reservEntry.uop = s.uops[pc];
+        robEntry.busy = true;
+        robEntry.instr = reservEntry.instr;
+        robEntry.uop = reservEntry.uop;
+        robEntry.instrStatus = ISSUING;
+        robEntry.execUnit = unit;
+        robEntry.pc = pc;
+        s.activeMask |= MachineState::bit(unit);
+        reservEntry.exTimeLeft = traits.latency == LAT_LOAD     ? config.loadExec
+                                 : traits.latency == LAT_BRANCH ? config.branchExec
+                                                                : config.intExec;
+        auto width = group.width();
+        readLanes(group, traits.vj, pc, unit, &group.vj[unit * width], reservEntry.Qj);
+        readLanes(group, traits.vk, pc, unit, &group.vk[unit * width], reservEntry.Qk);
+        if (traits.dest != FIELD_NONE)
+            s.regResult[reservEntry.uop.rd] = RegResultEntry{false, (word)robIdx};
+
+        if (traits.control == CTRL_BRANCH) {
+            if (config.branchRecovery == WRITEBACK)
+                s.branchCheckpoints[robIdx] = {s.regResult, s.predictor.specHistory};
+            auto target = s.getTarget(pc);
+            s.predictor.speculate(target != pc + 1);
+            s.pc = target;
+            robEntry.address = s.pc;
+        } else if (traits.control == CTRL_JUMP) {
+            s.pc += robEntry.uop.imm + 1;
+        } else if (s.pc < s.memorySize - 1) {
+            s.pc += 1;
+        }
+        return true;
+    }
+
+    void writeLanes(LaneGroup& group, word unit) {
+        //* 同 `nextStep` 中的 `writeResult`: 各列的结果按列计算并广播, 其余只做一次
+        auto& s = group.skel;
+        auto width = group.width();
+        auto& reserv = s.reservation[unit];
+        auto robIdx = reserv.robIdx;
+        auto& values = group.values;
+        values.resize(width);
+        const auto* vj = &group.vj[unit * width];
+        const auto* vk = &group.vk[unit * width];
+        auto imm = reserv.uop.imm;
+        const auto& traits = OPTRAITS[reserv.uop.op];
+        switch (traits.valid ? traits.alu : ALU_NONE) {
+        case ALU_FUNC:
+            for (size_t k = 0; k < width; k++)
+                values[k] = aluFunc(imm, vj[k], vk[k]);
+            break;
+        case ALU_ADD_IMM:
+            for (size_t k = 0; k < width; k++)
+                values[k] = vj[k] + imm;
+            break;
+        case ALU_AND_IMM:
+            for (size_t k = 0; k < width; k++)
+                values[k] = vj[k] & imm;
+            break;
+        case ALU_LOAD: {
+            // 组内各列的地址相同, 转发的 store 也相同, 只是数据不同
+            auto address = vj[0] + imm;
+            auto idx = s.forwardingStore(robIdx, address);
+            if (idx != INVALID)
+                std::copy_n(&group.result[idx * width], width, values.begin());
+            else if (address < s.memory.size())
+                for (size_t k = 0; k < width; k++)
+                    values[k] = memories[group.lanes[k]][address];
+            else
+                std::fill(values.begin(), values.end(), 0);
+            break;
+        }
+        case ALU_VJ:
+            std::copy_n(vj, width, values.begin());
+            break;
+        case ALU_VK:
+            std::copy_n(vk, width, values.begin());
+            break;
+        case ALU_IMM:
+            std::fill(values.begin(), values.end(), imm);
+            break;
+        default:
+            std::fill(values.begin(), values.end(), 0);
+        }
+
+        // 广播, 同 `broadcastUpdate`
+        for (auto mask = s.waiters[unit]; mask; mask &= mask - 1) {
+            auto waiting = (word)__builtin_ctzll(mask);
+            auto& other = s.reservation[waiting];
+            if (other.Qj == unit) {
+                std::copy_n(values.begin(), width, &group.vj[waiting * width]);
+                other.Qj = READY;
+            }
+            if (other.Qk == unit) {
+                std::copy_n(values.begin(), width, &group.vk[waiting * width]);
+                other.Qk = READY;
+            }
+        }
+        s.waiters[unit] = 0;
+        auto& robEntry = s.rob[robIdx];
+        if (robEntry.busy && !robEntry.valid && robEntry.execUnit == unit) {
+            std::copy_n(values.begin(), width, &group.result[robIdx * width]);
+            robEntry.valid = true;
+        }
+
+        reserv = {};
+        s.activeMask &= ~MachineState::bit(unit);
+        s.written.push_back(robIdx);
+        auto op = robEntry.uop.op;
+        if ((op == SW || op == LW) && robEntry.valid) {
+            s.robAddress[robIdx] = robEntry.address;
+            (op == SW ? s.robStores : s.robLoads)[robIdx / 64] |= MachineState::bit(robIdx % 64);
+        }
+        if (op == SW)
+            s.checkOrder(robIdx);
+        else if (op == BEQZ && s.config.branchRecovery == WRITEBACK)
+            s.resolveBranch(robIdx, group.result[robIdx * width] == 0);
+    }
+
+    void commitLanes(LaneGroup& group, word robIdx) {
+        //* 同 `commitOp`, 目的寄存器按列写回
+        auto& s = group.skel;
+        auto width = group.width();
+        auto& robEntry = s.rob[robIdx];
+        auto op = robEntry.uop.op;
+        const auto& traits = OPTRAITS[op];
+        if (traits.valid && op == LW && robEntry.replay) {
+            s.stats.replays += 1;
+            s.flushPipeline(robEntry.pc);
+            return;
+        }
+        if (traits.valid && traits.control == CTRL_BRANCH) {
+            s.commitBranch(robIdx, group.result[robIdx * width] == 0);
+        } else if (traits.valid && op == SW) {
+            commitStoreLanes(group, robIdx);
+        } else {
+            if (traits.valid && traits.dest != FIELD_NONE) {
+                auto rd = robEntry.uop.rd;
+                if (s.regResult[rd].robIdx == robIdx)
+                    s.regResult[rd] = {};
+                for (size_t k = 0; k < width; k++)
+                    regs[group.lanes[k] * NUMREGS + rd] = group.result[robIdx * width + k];
+            }
+            s.retire(robIdx);
+            s.robPop();
+        }
+    }
+
+    void commitStoreLanes(LaneGroup& group, word robIdx) {
+        //* 同 `MachineState::commitStore`, 各列的数据写入各自的内存; 记录写入代码的数据是否相同
+        auto& s = group.skel;
+        const auto& config = s.config;
+        auto width = group.width();
+        auto& robEntry = s.rob[robIdx];
+        auto unit = robEntry.execUnit;
+        if (!config.isStore(unit)) {
+            for (auto reservIdx = config.firstStore(); reservIdx < config.firstInt(); ++reservIdx) {
+                auto& reserv = s.reservation[reservIdx];
+                if (!reserv.busy) {
+                    auto latency = s.storeLatency(robEntry.address);
+                    reserv = ResStation{true, robEntry.instr, robEntry.uop, 0, robEntry.address, READY, READY,
+                                        latency - 1, robIdx};
+                    std::copy_n(&group.result[robIdx * width], width, &group.vj[reservIdx * width]);
+                    std::fill_n(&group.vk[reservIdx * width], width, robEntry.address);
+                    robEntry.execUnit = reservIdx;
+                    return;
+                }
+            }
+        } else if (s.reservation[unit].exTimeLeft == 0) {
+            const auto* values = &group.vj[unit * width];
+            auto address = s.reservation[unit].Vk;
+            if (address >= s.memory.size())
+                throw TomasuloError("Store to invalid address", address, "at pc=", robEntry.pc);
+            for (size_t k = 0; k < width; k++)
+                memories[group.lanes[k]].write(address, values[k]);
+            if (address < s.memorySize)
+                group.markCode(address, std::any_of(values + 1, values + width, [&](word v) { return v != *values; }));
+            s.invalidateUops(address, 1);
+            s.reservation[unit] = {};
+            s.retire(robIdx);
+            s.robPop();
+        } else {
+            s.reservation[unit].exTimeLeft -= 1;
+        }
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "config.hpp"
+#include "defines.hpp"
+
+struct CacheLine { /* 数据缓存行, 只记录标签, 数据仍在 memory 中 */
+    bool valid;    /* 有效位 */
+    bool dirty;    /* 写回策略下被 store 修改过 */
+    word tag;      /* 行地址除去组号之后的部分 */
+
+    bool operator==(const CacheLine& o) const {
+        return valid == o.valid && dirty == o.dirty && tag == o.tag;
+    }
+};
+
+/*
+ * L1 数据缓存的时序模型:
+ * 数据始终从 memory 读写, 缓存只决定访问的延迟, 因此打开缓存不会改变程序的结果.
+ * 组相联, 组内按 LRU 替换, 每组的次序与分支预测缓冲栈一样以每路 4 bit 存放.
+ * load 总是分配缓存行; store 未命中时按 write-allocate 决定是否分配.
+ * 写回策略下 store 命中只标记脏行, 替换脏行时计一次写回; 假设有写缓冲, 写回不增加延迟.
+ * 写直达策略下每个 store 都要写内存, 无论是否命中都按未命中计算延迟.
+ * 错误预测路径上的 load 也会访问缓存, 与真实的机器一样会污染缓存.
+ */
+class DataCache {
+  public:
+    DataCache() : DataCache(MachineConfig{}) {
+    }
+
+    explicit DataCache(const MachineConfig& config)
+        : ways(config.cacheSize ? config.cacheWays : 0),
+          lineShift(config.cacheSize ? __builtin_ctz(config.cacheLineWords) : 0),
+          setMask(config.cacheSize ? config.cacheSets() - 1 : 0),
+          setShift(config.cacheSize ? __builtin_ctz(config.cacheSets()) : 0), writeBack(config.cacheWriteBack),
+          writeAllocate(config.cacheWriteAllocate), hitLatency(config.cacheHitLatency),
+          missLatency(config.cacheMissLatency),
+          lines(config.cacheSize ? config.cacheSize / config.cacheLineWords : 0, CacheLine{false, false, 0}),
+          repl(config.cacheSize ? config.cacheSets() : 0, initialRepl(ways)) {
+    }
+
+    bool enabled() const {
+        return !lines.empty();
+    }
+
+    word access(word address, bool isWrite, Stats& stats) {
+        //* 访问 `address` 所在的行, 更新命中与缺失的计数, 返回访问的延迟
+        auto lineAddr = address >> lineShift;
+        auto set = lineAddr & setMask;
+        auto tag = lineAddr >> setShift;
+        auto entries = &lines[set * ways];
+        for (word w = 0; w < ways; ++w) {
+            if (entries[w].valid && entries[w].tag == tag) {
+                stats.cacheHits += 1;
+                touch(set, w);
+                if (isWrite && writeBack) {
+                    entries[w].dirty = true;
+                    return hitLatency;
+                }
+                return isWrite ? missLatency : hitLatency;
+            }
+        }
+        stats.cacheMisses += 1;
+        if (isWrite && !writeAllocate)
+            return missLatency;
+        auto way = victim(set);
+        if (entries[way].valid && entries[way].dirty)
+            stats.cacheWritebacks += 1;
+        entries[way] = {true, isWrite && writeBack, tag};
+        touch(set, way);
+        return missLatency;
+    }
+
+    word ways;                      /* 以下由 config 导出 */
+    word lineShift;
+    word setMask;
+    word setShift;
+    bool writeBack;
+    bool writeAllocate;
+    word hitLatency;
+    word missLatency;
+    std::vector<CacheLine> lines{}; /* 同一组的各路连续存放 */
+    std::vector<uint64_t> repl{};   /* 每组的 LRU 次序, 每路 4 bit, 0 表示最近使用 */
+
+  private:
+    static uint64_t initialRepl(word ways) {
+        //* 初始次序为路号
+        uint64_t ret = 0;
+        for (word w = 0; w < ways; w++)
+            ret |= uint64_t(w) << (4 * w);
+        return ret;
+    }
+
+    void touch(word set, word way) {
+        auto& order = repl[set];
+        auto rank = (order >> (4 * way)) & 0xf;
+        for (word w = 0; w < ways; w++)
+            if (((order >> (4 * w)) & 0xf) < rank)
+                order += uint64_t(1) << (4 * w);
+        order &= ~(uint64_t(0xf) << (4 * way));
+    }
+
+    word victim(word set) const {
+        //* 优先使用编号最小的空闲路, 否则替换最久未使用的一路
+        auto entries = &lines[set * ways];
+        for (word w = 0; w < ways; w++)
+            if (!entries[w].valid)
+                return w;
+        for (word w = 0; w < ways; w++)
+            if (((repl[set] >> (4 * w)) & 0xf) == ways - 1)
+                return w;
+        __builtin_unreachable();
+    }
+};
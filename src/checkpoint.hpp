@@ -0,0 +1,410 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "config.hpp"
+#include "defines.hpp"
+#include "error.hpp"
+#include "state.hpp"
+
+/*
+ * 检查点文件格式 (小端, 与本机结构体布局一致):
+ *   文件头: 8 字节魔数, u32 版本号, u32 小节数
+ *   小节:   u32 标签, u32 元素大小, u64 负载字节数, 负载补齐到 8 字节
+ * 小节依次为:
+ *   CONF  机器参数, 按名称记录, 因此新增参数不会破坏旧文件
+ *   SCAL  pc, 周期数, ROB 头尾指针, 统计信息等标量, 同样按名称记录
+ *   ROB, RSTN, BTB, BTBR, RGRS, RGFL, WAIT, WRTN  各表的原始内容, ROB 与 RSTN 中预译码的指令在载入时由指令字重新生成,
+ *                                                 WAIT 与 activeMask 由 RSTN 重建
+ *   BRCK  分支检查点, 仅在写回时恢复时非空
+ *   PPHT, PLOC, PCHO, PTAG  分支预测器的各表, 参见 `BranchPredictor`
+ *   DCLN, DCRP  数据缓存的标签与替换状态, 参见 `DataCache`
+ *   UBSY, ROCC  各执行单元的忙碌周期数与 ROB 占用的直方图
+ *   MEM   稀疏内存映像: u32 memSize, u32 段数, 每段为 u32 起始地址, u32 长度和各个字
+ * 结构体的布局改变时需要增加 CHECKPOINT_VERSION.
+ */
+constexpr char CHECKPOINT_MAGIC[8] = {'T', 'O', 'M', 'A', 'C', 'K', 'P', 'T'};
+constexpr uint32_t CHECKPOINT_VERSION = 3;
+constexpr word CHECKPOINT_ZERO_GAP = 16; /* 至少这么多个连续的零字才会把内存映像分段 */
+
+constexpr uint32_t checkpointTag(const char (&name)[5]) {
+    return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8 | uint32_t(uint8_t(name[2])) << 16 |
+           uint32_t(uint8_t(name[3])) << 24;
+}
+
+template <class Self, class F> void visitCheckpointScalars(Self& state, F&& f) {
+    //* 依次以 (名称, 引用) 访问需要保存的标量
+    f("pc", state.pc);
+    f("cycles", state.cycles);
+    f("robHeadIdx", state.robHeadIdx);
+    f("robTailIdx", state.robTailIdx);
+    f("memorySize", state.memorySize);
+    f("activeMask", state.activeMask);
+    f("stats.committed", state.stats.committed);
+    f("stats.mispredicts", state.stats.mispredicts);
+    f("stats.stalls", state.stats.stalls);
+    f("stats.stallsNoStation", state.stats.stallsNoStation);
+    f("stats.stallsRobFull", state.stats.stallsRobFull);
+    f("stats.cdbConflicts", state.stats.cdbConflicts);
+    f("stats.flushes", state.stats.flushes);
+    f("stats.branches", state.stats.branches);
+    f("stats.cacheHits", state.stats.cacheHits);
+    f("stats.cacheMisses", state.stats.cacheMisses);
+    f("stats.cacheWritebacks", state.stats.cacheWritebacks);
+    f("stats.replays", state.stats.replays);
+    f("stats.fastForwarded", state.stats.fastForwarded);
+    f("predictor.history", state.predictor.history);
+    f("predictor.specHistory", state.predictor.specHistory);
+    f("fetchStall", state.fetchStall);
+}
+
+class CheckpointWriter {
+  public:
+    void section(const char (&tag)[5], uint32_t elemSize, const void* data, uint64_t size) {
+        put(checkpointTag(tag));
+        put(elemSize);
+        put(size);
+        append(data, size);
+        buffer.resize((buffer.size() + 7) & ~size_t(7));
+        numSections += 1;
+    }
+
+    template <class Table> void table(const char (&tag)[5], const Table& arr) {
+        static_assert(std::is_trivially_copyable_v<typename Table::value_type>);
+        section(tag, sizeof(typename Table::value_type), arr.data(), arr.size() * sizeof(typename Table::value_type));
+    }
+
+    template <class Visit> void named(const char (&tag)[5], Visit&& visit) {
+        //* 名称-数值对: u32 个数, 每项为 u8 名称长度, 名称, u64 数值
+        std::vector<char> payload(sizeof(uint32_t));
+        uint32_t count = 0;
+        visit([&](const char* name, auto& value) {
+            auto len = (uint8_t)strlen(name);
+            uint64_t num = value;
+            payload.push_back((char)len);
+            payload.insert(payload.end(), name, name + len);
+            payload.insert(payload.end(), (const char*)&num, (const char*)&num + sizeof(num));
+            count += 1;
+        });
+        memcpy(payload.data(), &count, sizeof(count));
+        section(tag, 0, payload.data(), payload.size());
+    }
+
+    void save(const std::string& path) const {
+        //* 先写入临时文件再改名, 避免中途失败留下损坏的检查点
+        auto tmp = path + ".tmp";
+        {
+            std::ofstream fout(tmp, std::ios::binary | std::ios::trunc);
+            if (!fout)
+                throw TomasuloError("Cannot open", tmp);
+            fout.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+            fout.write((const char*)&CHECKPOINT_VERSION, sizeof(CHECKPOINT_VERSION));
+            fout.write((const char*)&numSections, sizeof(numSections));
+            fout.write(buffer.data(), buffer.size());
+            if (!fout.flush())
+                throw TomasuloError("Failed to write", tmp);
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            throw TomasuloError("Cannot rename", tmp, "to", path);
+    }
+
+  private:
+    template <class T> void put(const T& value) {
+        append(&value, sizeof(value));
+    }
+
+    void append(const void* data, size_t size) {
+        buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+    }
+
+    std::vector<char> buffer{};
+    uint32_t numSections = 0;
+};
+
+class MappedFile {
+    //* 只读地映射整个文件, 析构时解除映射
+  public:
+    explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+        std::ifstream fin(path, std::ios::binary);
+        if (!fin)
+            throw TomasuloError("Cannot open", path);
+        fallback.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        data = fallback.data();
+        size = fallback.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw TomasuloError("Cannot open", path);
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw TomasuloError("Cannot stat", path);
+        }
+        size = (size_t)st.st_size;
+        if (size > 0) {
+            auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                close(fd);
+                throw TomasuloError("Cannot mmap", path);
+            }
+            data = (const char*)addr;
+        }
+        close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (data)
+            munmap((void*)data, size);
+#endif
+    }
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+  private:
+#if defined(_WIN32)
+    std::vector<char> fallback{};
+#endif
+};
+
+class CheckpointReader {
+    //* 在映射的文件上按顺序读取, 所有读取都检查边界
+  public:
+    CheckpointReader(const char* begin, size_t size, const std::string& source)
+        : cur(begin), end(begin + size), source(source) {
+    }
+
+    template <class T> T get() {
+        T value{};
+        memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    const char* take(uint64_t size) {
+        if (size > (uint64_t)(end - cur))
+            throw TomasuloError(source + ":", "truncated checkpoint");
+        auto ret = cur;
+        cur += size;
+        return ret;
+    }
+
+    const char* cur;
+    const char* end;
+    const std::string& source;
+};
+
+inline void saveCheckpoint(const MachineState& state, const std::string& path) {
+    //* 将完整的机器状态保存到 `path`
+    CheckpointWriter out{};
+    out.named("CONF", [&](auto&& f) { state.config.forEachField(f); });
+    out.named("SCAL", [&](auto&& f) { visitCheckpointScalars(state, f); });
+    out.table("ROB ", state.rob);
+    out.table("RSTN", state.reservation);
+    out.table("BTB ", state.btb);
+    out.table("BTBR", state.btbRepl);
+    out.table("RGRS", state.regResult);
+    out.table("RGFL", state.regFile);
+    out.table("WAIT", state.waiters);
+    out.table("WRTN", state.written);
+    out.table("BRCK", state.branchCheckpoints);
+    out.table("PPHT", state.predictor.pht);
+    out.table("PLOC", state.predictor.local);
+    out.table("PCHO", state.predictor.chooser);
+    out.table("PTAG", state.predictor.tagged);
+    out.table("DCLN", state.cache.lines);
+    out.table("DCRP", state.cache.repl);
+    out.table("UBSY", state.unitBusy);
+    out.table("ROCC", state.robOccupancy);
+
+    // 只需扫描已分配的页, 段不跨页
+    std::vector<word> image{state.config.memSize, 0};
+    state.memory.forEachPage([&](word number, const Page& page) {
+        for (word i = 0; i < PAGEWORDS;) {
+            if (page[i] == 0) {
+                i++;
+                continue;
+            }
+            word start = i, last = i;
+            for (; i < PAGEWORDS && i - last < CHECKPOINT_ZERO_GAP; i++)
+                if (page[i] != 0)
+                    last = i;
+            image.push_back((number << PAGEBITS) + start);
+            image.push_back(last - start + 1);
+            image.insert(image.end(), page.begin() + start, page.begin() + last + 1);
+            image[1] += 1;
+        }
+    });
+    out.section("MEM ", sizeof(word), image.data(), image.size() * sizeof(word));
+    out.save(path);
+}
+
+inline MachineState loadCheckpoint(const std::string& path) {
+    /*
+     * 从 `path` 恢复机器状态. 文件被映射到内存,
+     * 各表和内存段直接从映射区复制到状态中, 不经过中间缓冲.
+     */
+    MappedFile file(path);
+    CheckpointReader in(file.data, file.size, path);
+    if (memcmp(in.take(sizeof(CHECKPOINT_MAGIC)), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+        throw TomasuloError(path + ":", "not a checkpoint file");
+    auto version = in.get<uint32_t>();
+    if (version != CHECKPOINT_VERSION)
+        throw TomasuloError(path + ":", "unsupported checkpoint version", version, "expected", CHECKPOINT_VERSION);
+    auto numSections = in.get<uint32_t>();
+
+    struct Section {
+        uint32_t tag;
+        uint32_t elemSize;
+        CheckpointReader body;
+    };
+    auto next = [&]() {
+        auto tag = in.get<uint32_t>();
+        auto elemSize = in.get<uint32_t>();
+        auto size = in.get<uint64_t>();
+        auto body = in.take(size);
+        in.take(((size + 7) & ~uint64_t(7)) - size);
+        return Section{tag, elemSize, CheckpointReader(body, size, path)};
+    };
+    auto named = [&](CheckpointReader& body, auto&& assign) {
+        auto count = body.get<uint32_t>();
+        for (uint32_t i = 0; i < count; i++) {
+            auto len = body.get<uint8_t>();
+            std::string name(body.take(len), len);
+            auto value = body.get<uint64_t>();
+            if (!assign(name, value))
+                throw TomasuloError(path + ":", "unknown field", name);
+        }
+    };
+    auto table = [&](Section& sec, auto& arr) {
+        using T = typename std::remove_reference_t<decltype(arr)>::value_type;
+        auto size = (uint64_t)(sec.body.end - sec.body.cur);
+        if (sec.elemSize != sizeof(T) || size % sizeof(T) != 0)
+            throw TomasuloError(path + ":", "element size mismatch in section", std::string((const char*)&sec.tag, 4));
+        return size / sizeof(T);
+    };
+
+    if (numSections == 0)
+        throw TomasuloError(path + ":", "missing machine configuration");
+    auto conf = next();
+    if (conf.tag != checkpointTag("CONF"))
+        throw TomasuloError(path + ":", "the first section must be CONF");
+    MachineConfig config{};
+    named(conf.body, [&](const std::string& name, uint64_t value) { return config.set(name, (word)value); });
+    MachineState state{config};
+
+    auto fixed = [&](Section& sec, auto& arr) {
+        using T = typename std::remove_reference_t<decltype(arr)>::value_type;
+        if (table(sec, arr) != arr.size())
+            throw TomasuloError(path + ":", "size mismatch in section", std::string((const char*)&sec.tag, 4));
+        if (!arr.empty())
+            memcpy(arr.data(), sec.body.take(arr.size() * sizeof(T)), arr.size() * sizeof(T));
+    };
+    for (uint32_t i = 1; i < numSections; i++) {
+        auto sec = next();
+        if (sec.tag == checkpointTag("SCAL")) {
+            named(sec.body, [&](const std::string& name, uint64_t value) {
+                bool found = false;
+                visitCheckpointScalars(state, [&](const char* field, auto& ref) {
+                    if (name == field) {
+                        ref = (std::remove_reference_t<decltype(ref)>)value;
+                        found = true;
+                    }
+                });
+                return found;
+            });
+        } else if (sec.tag == checkpointTag("ROB ")) {
+            fixed(sec, state.rob);
+        } else if (sec.tag == checkpointTag("RSTN")) {
+            fixed(sec, state.reservation);
+        } else if (sec.tag == checkpointTag("BTB ")) {
+            fixed(sec, state.btb);
+        } else if (sec.tag == checkpointTag("BTBR")) {
+            fixed(sec, state.btbRepl);
+        } else if (sec.tag == checkpointTag("RGRS")) {
+            fixed(sec, state.regResult);
+        } else if (sec.tag == checkpointTag("RGFL")) {
+            fixed(sec, state.regFile);
+        } else if (sec.tag == checkpointTag("WAIT")) {
+            fixed(sec, state.waiters);
+        } else if (sec.tag == checkpointTag("WRTN")) {
+            state.written.resize(table(sec, state.written));
+            fixed(sec, state.written);
+        } else if (sec.tag == checkpointTag("BRCK")) {
+            fixed(sec, state.branchCheckpoints);
+        } else if (sec.tag == checkpointTag("PPHT")) {
+            fixed(sec, state.predictor.pht);
+        } else if (sec.tag == checkpointTag("PLOC")) {
+            fixed(sec, state.predictor.local);
+        } else if (sec.tag == checkpointTag("PCHO")) {
+            fixed(sec, state.predictor.chooser);
+        } else if (sec.tag == checkpointTag("PTAG")) {
+            fixed(sec, state.predictor.tagged);
+        } else if (sec.tag == checkpointTag("DCLN")) {
+            fixed(sec, state.cache.lines);
+        } else if (sec.tag == checkpointTag("DCRP")) {
+            fixed(sec, state.cache.repl);
+        } else if (sec.tag == checkpointTag("UBSY")) {
+            fixed(sec, state.unitBusy);
+        } else if (sec.tag == checkpointTag("ROCC")) {
+            fixed(sec, state.robOccupancy);
+        } else if (sec.tag == checkpointTag("MEM ")) {
+            if (sec.elemSize != sizeof(word))
+                throw TomasuloError(path + ":", "element size mismatch in section MEM");
+            if (sec.body.get<word>() != state.config.memSize)
+                throw TomasuloError(path + ":", "memory size does not match the configuration");
+            auto numRuns = sec.body.get<word>();
+            for (word r = 0; r < numRuns; r++) {
+                auto start = sec.body.get<word>();
+                auto len = sec.body.get<word>();
+                if (start > state.memory.size() || len > state.memory.size() - start)
+                    throw TomasuloError(path + ":", "memory run out of range");
+                // 不假定映射区按字对齐, 逐页从映射区 memcpy 到目标页, 不经过中间缓冲
+                state.memory.writeUnaligned(start, sec.body.take((uint64_t)len * sizeof(word)), len);
+            }
+        } else {
+            throw TomasuloError(path + ":", "unknown section", std::string((const char*)&sec.tag, 4));
+        }
+    }
+
+    auto robSize = state.config.robSize;
+    bool ok = state.robHeadIdx < robSize && state.robTailIdx < robSize && state.memorySize <= state.memory.size();
+    for (auto& entry : state.regResult)
+        ok = ok && entry.robIdx < robSize;
+    for (auto& ckpt : state.branchCheckpoints)
+        for (auto& entry : ckpt.regResult)
+            ok = ok && entry.robIdx < robSize;
+    for (auto idx : state.written)
+        ok = ok && idx < robSize;
+    if (!ok)
+        throw TomasuloError(path + ":", "inconsistent machine state");
+    // 检查 ROB, 保留栈与 BTB 的各项; 唤醒位图与 activeMask 由保留栈重建, 覆盖 WAIT 小节与标量中保存的值
+    try {
+        state.rebuildRobIndex();
+        state.rebuildReservationIndex();
+        state.checkBtb();
+    } catch (const TomasuloError& e) {
+        throw TomasuloError(path + ":", e.what());
+    }
+    return state;
+}
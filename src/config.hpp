@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "defines.hpp"
+#include "error.hpp"
+
+/*
+ * 机器的几何参数与延迟, 缺省值与 `defines.hpp` 中的常量一致.
+ * 执行单元按 LOAD, STORE, INT 的顺序从 1 开始编号, 0 表示 READY.
+ */
+struct MachineConfig {
+    word robSize = ROBSIZE;       /* ROB 项数 */
+    word numLoad = 2;             /* LOAD 保留栈数量 */
+    word numStore = 2;            /* STORE 保留栈数量 */
+    word numInt = 2;              /* INT 保留栈数量 */
+    word btbSize = BTBSIZE;       /* 分支预测缓冲栈项数 */
+    word btbWays = 8;             /* 分支预测缓冲栈的相联度, 大于 btbSize 时为全相联 */
+    word btbReplacement = LRU;    /* 组内替换算法, 见 `BTBReplacement` */
+    word btbTagBits = 0;          /* 部分标签的位数, 0 表示比较完整的 PC */
+    word memSize = MEMSIZE;       /* 内存字数, 0 表示完整的 32 位地址空间 */
+    word memCopyOnWrite = 1;      /* 复制状态时是否共享内存页面, 写入时再复制 */
+    word intExec = INTEXEC;       /* 整数运算延迟 */
+    word loadExec = LDEXEC;       /* Load 延迟 */
+    word storeExec = STEXEC;      /* Store 延迟 */
+    word branchExec = BRANCHEXEC; /* 分支延迟 */
+    word issueWidth = 1;          /* 每周期最多发射的指令数 */
+    word commitWidth = 1;         /* 每周期最多提交的指令数 */
+    word numCDB = 1;              /* 公共数据总线的数量 */
+    word predictor = BIMODAL;     /* 分支方向预测器, 见 `PredictorKind` */
+    word phtBits = 10;            /* 预测器计数器表的索引位数 */
+    word historyBits = 10;        /* gshare 与 tournament 使用的全局历史长度 */
+    word branchRecovery = COMMIT; /* 分支预测错误的恢复时机, 见 `BranchRecovery` */
+    word recoveryLatency = 0;     /* 重定向之后停止发射的周期数 */
+    word cacheSize = 0;           /* L1 数据缓存的字数, 0 表示不模拟缓存, load 与 store 使用固定延迟 */
+    word cacheWays = 4;           /* 数据缓存的相联度 */
+    word cacheLineWords = 4;      /* 缓存行的字数 */
+    word cacheWriteBack = 1;      /* 1 为写回, 0 为写直达 */
+    word cacheWriteAllocate = 1;  /* store 未命中时是否分配缓存行 */
+    word cacheHitLatency = 1;     /* 命中延迟, 打开缓存时代替 loadExec 与 storeExec */
+    word cacheMissLatency = 10;   /* 缺失延迟 */
+
+    word numUnits() const {
+        return numLoad + numStore + numInt;
+    }
+
+    word firstLoad() const {
+        return 1;
+    }
+
+    word firstStore() const {
+        return firstLoad() + numLoad;
+    }
+
+    word firstInt() const {
+        return firstStore() + numStore;
+    }
+
+    word btbAssoc() const {
+        return btbWays < btbSize ? btbWays : btbSize;
+    }
+
+    word btbSets() const {
+        return btbSize / btbAssoc();
+    }
+
+    word cacheSets() const {
+        return cacheSize / (cacheWays * cacheLineWords);
+    }
+
+    bool isStore(word unit) const {
+        return unit >= firstStore() && unit < firstInt();
+    }
+
+    std::string unitName(word unit) const {
+        //* 执行单元的名称, 如 LOAD1, INT2
+        if (unit == READY)
+            return "READY";
+        if (unit < firstStore())
+            return "LOAD" + std::to_string(unit - firstLoad() + 1);
+        if (unit < firstInt())
+            return "STORE" + std::to_string(unit - firstStore() + 1);
+        if (unit <= numUnits())
+            return "INT" + std::to_string(unit - firstInt() + 1);
+        throw TomasuloError("Invalid unit:", unit);
+    }
+
+    void validate() const {
+        if (robSize < 2)
+            throw TomasuloError("robSize must be at least 2, got", robSize);
+        if (numLoad == 0 || numStore == 0 || numInt == 0)
+            throw TomasuloError("Every kind of reservation station needs at least one entry");
+        if (numUnits() + 1 > 64)
+            throw TomasuloError("At most 63 reservation stations are supported, got", numUnits());
+        if (btbSize == 0 || btbWays == 0)
+            throw TomasuloError("btbSize and btbWays must be positive");
+        if (btbSize % btbAssoc() != 0 || (btbSets() & (btbSets() - 1)) != 0)
+            throw TomasuloError("btbSize / btbWays must be a power of two, got", btbSize, "/", btbWays);
+        if (btbReplacement >= NUMREPLACEMENTS)
+            throw TomasuloError("Invalid btbReplacement:", btbReplacement);
+        if (btbReplacement == LRU && btbAssoc() > 16)
+            throw TomasuloError("LRU supports at most 16 ways, got", btbAssoc());
+        if (btbReplacement == PLRU && (btbAssoc() > 64 || (btbAssoc() & (btbAssoc() - 1)) != 0))
+            throw TomasuloError("PLRU needs a power of two of at most 64 ways, got", btbAssoc());
+        if (btbTagBits > 32)
+            throw TomasuloError("btbTagBits must be at most 32, got", btbTagBits);
+        if (memCopyOnWrite > 1)
+            throw TomasuloError("memCopyOnWrite must be 0 or 1");
+        if (intExec == 0 || loadExec == 0 || storeExec == 0 || branchExec == 0)
+            throw TomasuloError("Latencies must be positive");
+        if (issueWidth == 0 || commitWidth == 0 || numCDB == 0)
+            throw TomasuloError("issueWidth, commitWidth and numCDB must be positive");
+        if (cacheSize != 0) {
+            if (cacheLineWords == 0 || (cacheLineWords & (cacheLineWords - 1)) != 0)
+                throw TomasuloError("cacheLineWords must be a power of two, got", cacheLineWords);
+            if (cacheWays == 0 || cacheWays > 16)
+                throw TomasuloError("cacheWays must be between 1 and 16, got", cacheWays);
+            if (cacheSize % (cacheWays * cacheLineWords) != 0 || (cacheSets() & (cacheSets() - 1)) != 0)
+                throw TomasuloError("cacheSize / (cacheWays * cacheLineWords) must be a power of two, got",
+                                    cacheSize, "/ (", cacheWays, "*", cacheLineWords, ")");
+            if (cacheWriteBack > 1 || cacheWriteAllocate > 1)
+                throw TomasuloError("cacheWriteBack and cacheWriteAllocate must be 0 or 1");
+            if (cacheHitLatency == 0 || cacheMissLatency < cacheHitLatency)
+                throw TomasuloError("Cache latencies must satisfy 0 < cacheHitLatency <= cacheMissLatency");
+        }
+        if (branchRecovery >= NUMRECOVERIES)
+            throw TomasuloError("Invalid branchRecovery:", branchRecovery);
+        if (predictor >= NUMPREDICTORS)
+            throw TomasuloError("Invalid predictor:", predictor);
+        if (phtBits < 4 || phtBits > 24)
+            throw TomasuloError("phtBits must be between 4 and 24, got", phtBits);
+        if (historyBits > 64)
+            throw TomasuloError("historyBits must be at most 64, got", historyBits);
+    }
+
+    bool operator==(const MachineConfig& other) const {
+        //* 各参数都是 word, 没有填充字节, 可以整体比较
+        static_assert(std::has_unique_object_representations_v<MachineConfig>);
+        return memcmp(this, &other, sizeof(MachineConfig)) == 0;
+    }
+
+    bool operator!=(const MachineConfig& other) const {
+        return !(*this == other);
+    }
+
+    template <class F> void forEachField(F&& f) {
+        //* 依次以 (名称, 引用) 访问每个参数
+        visitFields(*this, f);
+    }
+
+    template <class F> void forEachField(F&& f) const {
+        visitFields(*this, f);
+    }
+
+    bool set(const std::string& key, word value) {
+        //* 按名称设置一个参数, 名称不存在时返回 false
+        bool found = false;
+        forEachField([&](const char* name, word& field) {
+            if (key == name) {
+                field = value;
+                found = true;
+            }
+        });
+        return found;
+    }
+
+    static MachineConfig parse(const std::string& text, const std::string& source = "<string>") {
+        /*
+         * 解析配置文本, 每行形如 `key = value`, `#` 之后为注释.
+         * 未出现的参数保持缺省值.
+         */
+        MachineConfig config{};
+        std::istringstream sin(text);
+        std::string line{};
+        for (word lineno = 1; std::getline(sin, line); ++lineno) {
+            if (!stripComment(line))
+                continue;
+            config.parseLine(line, source, lineno);
+        }
+        config.validate();
+        return config;
+    }
+
+    static std::vector<std::pair<std::string, MachineConfig>> parseSections(const std::string& text,
+                                                                            const std::string& source = "<string>") {
+        /*
+         * 解析含多个 `[name]` 小节的配置文本, 用于参数扫描.
+         * 第一个小节之前的参数对所有小节生效, 小节内的参数覆盖之.
+         */
+        MachineConfig common{};
+        std::vector<std::pair<std::string, MachineConfig>> sections{};
+        std::istringstream sin(text);
+        std::string line{};
+        for (word lineno = 1; std::getline(sin, line); ++lineno) {
+            if (!stripComment(line))
+                continue;
+            line = trim(line);
+            if (line.front() == '[') {
+                if (line.back() != ']' || line.size() < 3)
+                    throw TomasuloError(source + ":" + std::to_string(lineno) + ":", "expected `[name]`");
+                sections.emplace_back(trim(line.substr(1, line.size() - 2)), common);
+                continue;
+            }
+            (sections.empty() ? common : sections.back().second).parseLine(line, source, lineno);
+        }
+        if (sections.empty())
+            sections.emplace_back("default", common);
+        for (auto& [name, config] : sections) {
+            try {
+                config.validate();
+            } catch (const TomasuloError& e) {
+                throw TomasuloError(source + ": [" + name + "]", e.what());
+            }
+        }
+        return sections;
+    }
+
+    static MachineConfig fromFile(const std::string& path) {
+        return parse(readFile(path), path);
+    }
+
+    static std::vector<std::pair<std::string, MachineConfig>> sectionsFromFile(const std::string& path) {
+        return parseSections(readFile(path), path);
+    }
+
+  private:
+    template <class Self, class F> static void visitFields(Self& self, F& f) {
+#define CONFIG_FIELD(name) f(#name, self.name);
+        CONFIG_FIELD(robSize)
+        CONFIG_FIELD(numLoad)
+        CONFIG_FIELD(numStore)
+        CONFIG_FIELD(numInt)
+        CONFIG_FIELD(btbSize)
+        CONFIG_FIELD(btbWays)
+        CONFIG_FIELD(btbReplacement)
+        CONFIG_FIELD(btbTagBits)
+        CONFIG_FIELD(memSize)
+        CONFIG_FIELD(memCopyOnWrite)
+        CONFIG_FIELD(intExec)
+        CONFIG_FIELD(loadExec)
+        CONFIG_FIELD(storeExec)
+        CONFIG_FIELD(branchExec)
+        CONFIG_FIELD(issueWidth)
+        CONFIG_FIELD(commitWidth)
+        CONFIG_FIELD(numCDB)
+        CONFIG_FIELD(predictor)
+        CONFIG_FIELD(phtBits)
+        CONFIG_FIELD(historyBits)
+        CONFIG_FIELD(branchRecovery)
+        CONFIG_FIELD(recoveryLatency)
+        CONFIG_FIELD(cacheSize)
+        CONFIG_FIELD(cacheWays)
+        CONFIG_FIELD(cacheLineWords)
+        CONFIG_FIELD(cacheWriteBack)
+        CONFIG_FIELD(cacheWriteAllocate)
+        CONFIG_FIELD(cacheHitLatency)
+        CONFIG_FIELD(cacheMissLatency)
+#undef CONFIG_FIELD
+    }
+
+    void parseLine(const std::string& line, const std::string& source, word lineno) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos)
+            throw TomasuloError(source + ":" + std::to_string(lineno) + ":", "expected `key = value`");
+        auto key = trim(line.substr(0, eq));
+        auto value = trim(line.substr(eq + 1));
+        char* end = nullptr;
+        auto num = strtoul(value.c_str(), &end, 0);
+        if ((value.empty() || *end != '\0') && !enumValue(key, value, num))
+            throw TomasuloError(source + ":" + std::to_string(lineno) + ":", "invalid value", value);
+        if (!set(key, num))
+            throw TomasuloError(source + ":" + std::to_string(lineno) + ":", "unknown key", key);
+    }
+
+    static bool enumValue(const std::string& key, const std::string& value, unsigned long& num) {
+        //* 允许以名称给出枚举类型的参数, 如 `predictor = gshare`
+        auto lookup = [&](const char* const* names, word count) {
+            for (word i = 0; i < count; i++) {
+                if (value == names[i]) {
+                    num = i;
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (key == "predictor")
+            return lookup(predictorname, NUMPREDICTORS);
+        if (key == "btbReplacement")
+            return lookup(replacementname, NUMREPLACEMENTS);
+        if (key == "branchRecovery")
+            return lookup(recoveryname, NUMRECOVERIES);
+        return false;
+    }
+
+    static bool stripComment(std::string& line) {
+        //* 去掉注释, 剩余内容为空白时返回 false
+        if (auto comment = line.find('#'); comment != std::string::npos)
+            line.erase(comment);
+        return line.find_first_not_of(" \t\r") != std::string::npos;
+    }
+
+    static std::string readFile(const std::string& path) {
+        std::ifstream fin(path);
+        if (!fin)
+            throw TomasuloError("Cannot open", path);
+        std::ostringstream sout{};
+        sout << fin.rdbuf();
+        return sout.str();
+    }
+
+    static std::string trim(const std::string& str) {
+        auto begin = str.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+            return "";
+        auto end = str.find_last_not_of(" \t\r");
+        return str.substr(begin, end - begin + 1);
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "defines.hpp"
+#include <array>
 #include <string.h>
 #include <type_traits>
 
@@ -48,3 +49,147 @@ inline constexpr word immEx(word instr) {
 inline constexpr word jmpOffsetEx(word instr) {
     return signExtend<26>(getField(instr, 25, 0));
 }
+
+// 以下为编码函数, 与 `scripts/assembler.py` 中的 `instr_i`, `instr_r`, `instr_j` 一一对应
+
+inline constexpr word encodeI(word op, word rs1, word rd, word imm) {
+    return (op & maskN(6)) << 26 | (rs1 & maskN(5)) << 21 | (rd & maskN(5)) << 16 | (imm & maskN(16));
+}
+
+inline constexpr word encodeR(word rs1, word rs2, word rd, word funccode) {
+    return (RR_ALU & maskN(6)) << 26 | (rs1 & maskN(5)) << 21 | (rs2 & maskN(5)) << 16 | (rd & maskN(5)) << 11 |
+           (funccode & maskN(11));
+}
+
+inline constexpr word encodeJ(word op, word offset) {
+    return (op & maskN(6)) << 26 | (offset & maskN(26));
+}
+
+/*
+ * 操作码特性表: 预译码与流水线各阶段按表中的字段处理指令, 而不是各自按操作码分支.
+ * 一般的运算指令只需在 `makeOpTraits` 中增加一项 (以及汇编器中的助记符);
+ * 访存, 分支与跳转另有专门的处理.
+ */
+enum OperandKind : uint8_t {
+    OPND_NONE,   /* 不使用, V 为 0 且立即就绪 */
+    OPND_RS1,    /* 寄存器 rs1 */
+    OPND_RS2,    /* 寄存器 rs2 */
+    OPND_NEXTPC, /* 下一条指令的地址 */
+};
+
+enum RegField : uint8_t {
+    FIELD_NONE, /* 没有目的寄存器 */
+    FIELD_RT,   /* [20, 16], I 型指令 */
+    FIELD_RD,   /* [15, 11], R 型指令 */
+};
+
+enum ImmField : uint8_t {
+    IMM_NONE,
+    IMM_16,   /* 符号扩展的 16 位立即数 */
+    IMM_26,   /* 符号扩展的 26 位跳转偏移 */
+    IMM_FUNC, /* 11 位功能码, 只接受 FUNC_ADD, FUNC_SUB 与 FUNC_AND */
+};
+
+enum UnitClass : uint8_t {
+    UNIT_INT,  /* 整数保留栈, 也接收 store, 分支与跳转 */
+    UNIT_LOAD, /* load 保留栈 */
+};
+
+enum LatencyClass : uint8_t {
+    LAT_INT,    /* config.intExec */
+    LAT_LOAD,   /* config.loadExec, 打开缓存时在执行时按地址重新确定 */
+    LAT_BRANCH, /* config.branchExec */
+};
+
+enum AluFunc : uint8_t {
+    ALU_NONE,    /* 结果为 0 */
+    ALU_FUNC,    /* Vj 与 Vk 按功能码运算 */
+    ALU_ADD_IMM, /* Vj + imm */
+    ALU_AND_IMM, /* Vj & imm */
+    ALU_LOAD,    /* 读取内存 Vj + imm */
+    ALU_VJ,      /* Vj, beqz 据此判断是否跳转 */
+    ALU_VK,      /* Vk, store 写入的值 */
+    ALU_IMM,     /* 立即数 */
+};
+
+enum ControlKind : uint8_t {
+    CTRL_NONE,
+    CTRL_BRANCH, /* 条件分支, 发射时预测, 提交或写回时验证 */
+    CTRL_JUMP,   /* 发射时即改变 pc */
+    CTRL_HALT,   /* 提交时停机 */
+};
+
+struct OpTraits {
+    bool valid = false;             /* 是否为有效的操作码 */
+    OperandKind vj = OPND_NONE;     /* Vj 的来源 */
+    OperandKind vk = OPND_NONE;     /* Vk 的来源 */
+    RegField dest = FIELD_NONE;     /* 目的寄存器所在的字段, 提交时写回 */
+    ImmField imm = IMM_NONE;        /* 立即数字段 */
+    UnitClass unit = UNIT_INT;      /* 发射到哪一类保留栈 */
+    LatencyClass latency = LAT_INT; /* 执行的周期数 */
+    AluFunc alu = ALU_NONE;         /* 写回的结果 */
+    ControlKind control = CTRL_NONE;
+};
+
+inline constexpr std::array<OpTraits, 256> makeOpTraits() {
+    //* 以 `MicroOp::op` 为下标, 所以 ILLEGAL_OP 与 UNDECODED_OP 也有 (无效的) 表项
+    std::array<OpTraits, 256> t{};
+    // clang-format off
+    //                 vj         vk           dest        imm       unit       latency     alu          control
+    t[RR_ALU] = {true, OPND_RS1,  OPND_RS2,    FIELD_RD,   IMM_FUNC, UNIT_INT,  LAT_INT,    ALU_FUNC,    CTRL_NONE};
+    t[ADDI]   = {true, OPND_RS1,  OPND_NONE,   FIELD_RT,   IMM_16,   UNIT_INT,  LAT_INT,    ALU_ADD_IMM, CTRL_NONE};
+    t[ANDI]   = {true, OPND_RS1,  OPND_NONE,   FIELD_RT,   IMM_16,   UNIT_INT,  LAT_INT,    ALU_AND_IMM, CTRL_NONE};
+    t[LW]     = {true, OPND_RS1,  OPND_NONE,   FIELD_RT,   IMM_16,   UNIT_LOAD, LAT_LOAD,   ALU_LOAD,    CTRL_NONE};
+    t[SW]     = {true, OPND_RS1,  OPND_RS2,    FIELD_NONE, IMM_16,   UNIT_INT,  LAT_INT,    ALU_VK,      CTRL_NONE};
+    t[BEQZ]   = {true, OPND_RS1,  OPND_NONE,   FIELD_NONE, IMM_16,   UNIT_INT,  LAT_BRANCH, ALU_VJ,      CTRL_BRANCH};
+    t[J]      = {true, OPND_NONE, OPND_NEXTPC, FIELD_NONE, IMM_26,   UNIT_INT,  LAT_INT,    ALU_IMM,     CTRL_JUMP};
+    t[HALT]   = {true, OPND_NONE, OPND_NONE,   FIELD_NONE, IMM_NONE, UNIT_INT,  LAT_INT,    ALU_NONE,    CTRL_HALT};
+    t[NOOP]   = {true, OPND_NONE, OPND_NONE,   FIELD_NONE, IMM_NONE, UNIT_INT,  LAT_INT,    ALU_NONE,    CTRL_NONE};
+    // clang-format on
+    return t;
+}
+inline constexpr std::array<OpTraits, 256> OPTRAITS = makeOpTraits();
+
+inline constexpr word aluFunc(word funccode, word a, word b) {
+    //* R 型指令的运算, 功能码已在预译码时检查
+    switch (funccode) {
+    case FUNC_ADD:
+        return a + b;
+    case FUNC_SUB:
+        return a - b;
+    default:
+        return a & b;
+    }
+}
+
+inline constexpr MicroOp predecode(word instr) {
+    //* 按特性表一次提取指令的全部字段; 操作码或功能码无效时 op 为 ILLEGAL_OP
+    MicroOp uop{};
+    const auto& traits = OPTRAITS[opcode(instr)];
+    if (!traits.valid) {
+        uop.op = ILLEGAL_OP;
+        return uop;
+    }
+    uop.op = (uint8_t)opcode(instr);
+    uop.rs1 = (uint8_t)reg1(instr);
+    if (traits.vj == OPND_RS2 || traits.vk == OPND_RS2)
+        uop.rs2 = (uint8_t)reg2(instr);
+    if (traits.dest != FIELD_NONE)
+        uop.rd = (uint8_t)(traits.dest == FIELD_RD ? reg3(instr) : reg2(instr));
+    switch (traits.imm) {
+    case IMM_16:
+        uop.imm = immEx(instr);
+        break;
+    case IMM_26:
+        uop.imm = jmpOffsetEx(instr);
+        break;
+    case IMM_FUNC:
+        uop.imm = func(instr);
+        if (uop.imm != FUNC_ADD && uop.imm != FUNC_SUB && uop.imm != FUNC_AND)
+            uop.op = ILLEGAL_OP;
+        break;
+    case IMM_NONE:
+        break;
+    }
+    return uop;
+}
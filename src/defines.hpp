@@ -7,11 +7,20 @@
 using word = uint32_t;
 
 constexpr word MAXLINELENGTH = 1000; /* 机器指令的最大长度 */
-constexpr word MEMSIZE = 10000;      /* 内存的最大容量     */
+constexpr word MEMSIZE = 10000;      /* 内存的缺省容量     */
 constexpr word NUMREGS = 32;         /* 寄存器数量         */
 
 constexpr word INVALID = (word)-1;
 
+/*
+ * 性能计数器: 编译时定义 TOMASULO_COUNTERS=0 可以去掉逐周期更新的计数器,
+ * 此时它们保持为 0; `Stats` 中原有的计数不受影响.
+ */
+#ifndef TOMASULO_COUNTERS
+#define TOMASULO_COUNTERS 1
+#endif
+constexpr bool COUNTERS = TOMASULO_COUNTERS;
+
 /*
  * 操作码和功能码定义
  */
@@ -35,7 +44,7 @@ constexpr word NOOP_INSTR = 0x0c000000;
 ;
 
 /*
- * 执行单元
+ * 执行单元, 这里是缺省配置下的编号, 参见 `MachineConfig`
  */
 constexpr word READY = 0;
 constexpr word LOAD1 = 1;
@@ -45,11 +54,10 @@ constexpr word STORE2 = 4;
 constexpr word INT1 = 5;
 constexpr word INT2 = 6;
 
-constexpr word NUMUNITS = 6;                                                                    /* 执行单元数量 */
-inline const char* unitname[NUMUNITS] = {"LOAD1", "LOAD2", "STORE1", "STORE2", "INT1", "INT2"}; /* 执行单元的名称 */
+constexpr word NUMUNITS = 6; /* 执行单元数量 */
 
 /*
- * 不同操作所需要的周期数
+ * 不同操作所需要的周期数 (缺省值)
  */
 constexpr word BRANCHEXEC = 3; /* 分支操作 */
 constexpr word LDEXEC = 2;     /* Load     */
@@ -65,8 +73,8 @@ constexpr word WRITING_RESULT = 2;
 constexpr word COMMITTING = 3;                                                              /* 提交   */
 inline const char* statename[4] = {"ISSUING", "EXECUTING", "WRITINGRESULT", "COMMTITTING"}; /*  状态名称 */
 
-constexpr word ROBSIZE = 16; /* ROB 有 16 个单元 */
-constexpr word BTBSIZE = 8;  /* 分支预测缓冲栈有 8 个单元 */
+constexpr word ROBSIZE = 16; /* ROB 缺省有 16 个单元 */
+constexpr word BTBSIZE = 8;  /* 分支预测缓冲栈缺省有 8 个单元 */
 
 /*
  * 2 bit 分支预测状态
@@ -77,37 +85,113 @@ enum BHT {
     WEAKTAKEN = 2,
     STRONGTAKEN = 3,
 };
+/*
+ * 分支预测缓冲栈组内的替换算法
+ */
+enum BTBReplacement {
+    LRU = 0,  /* 最近最少使用 */
+    PLRU = 1, /* 树形伪 LRU, 路数需为 2 的幂 */
+};
+inline const char* replacementname[2] = {"lru", "plru"}; /* 替换算法名称 */
+constexpr word NUMREPLACEMENTS = 2;
+
+/*
+ * 分支预测错误的恢复时机
+ */
+enum BranchRecovery {
+    COMMIT = 0,    /* 分支提交时发现预测错误, 清空整个流水线 */
+    WRITEBACK = 1, /* 分支写回时发现预测错误, 只清除比它年轻的指令 */
+};
+inline const char* recoveryname[2] = {"commit", "writeback"}; /* 恢复方式名称 */
+constexpr word NUMRECOVERIES = 2;
+
+/*
+ * 分支方向预测器, 参见 `BranchPredictor`
+ */
+enum PredictorKind {
+    BIMODAL = 0,    /* 分支预测缓冲栈中每项的 2-bit 计数器 */
+    GSHARE = 1,     /* 全局历史与 pc 异或索引的 2-bit 计数器表 */
+    TOURNAMENT = 2, /* bimodal 与 gshare 之间按 pc 选择 */
+    TAGE = 3,       /* 带标签, 历史长度呈几何级数的多张表 */
+};
+inline const char* predictorname[4] = {"bimodal", "gshare", "tournament", "tage"}; /* 预测器名称 */
+constexpr word NUMPREDICTORS = 4;
+
 /*
  * 分支跳转结果
  */
 constexpr bool NOTTAKEN = false;
 constexpr bool TAKEN = true;
 
+constexpr uint8_t ILLEGAL_OP = 0xff;   /* 预译码时发现的非法指令, 有效的操作码只有 6 位 */
+constexpr uint8_t UNDECODED_OP = 0xfe; /* 预译码缓存中尚未译码或已失效的项 */
+
+struct MicroOp {  /* 预译码的指令, 由 `predecode` 生成, 之后各阶段不再从指令字中提取字段 */
+    uint8_t op;   /* 操作码, 或者 ILLEGAL_OP, UNDECODED_OP */
+    uint8_t rs1;  /* 源寄存器, 读入 Vj */
+    uint8_t rs2;  /* 源寄存器, 读入 Vk */
+    uint8_t rd;   /* 目的寄存器 */
+    word imm;     /* 符号扩展后的立即数; j 指令为 26 位的跳转偏移, ALU 运算为功能码 */
+
+    bool operator==(const MicroOp& o) const {
+        return op == o.op && rs1 == o.rs1 && rs2 == o.rs2 && rd == o.rd && imm == o.imm;
+    }
+};
+static_assert(sizeof(MicroOp) == 8, "micro-ops are copied into every ROB entry and reservation station");
+constexpr MicroOp UNDECODED_UOP = {UNDECODED_OP, 0, 0, 0, 0};
+
 struct ResStation { /* 保留栈的数据结构 */
     bool busy;      /* 空闲标志位 */
     word instr;     /*    指令    */
+    MicroOp uop;    /* 预译码的指令 */
     word Vj;        /* Vj, Vk 存放操作数 */
     word Vk;
     word Qj;         /* Qj, Qk 存放将会生成结果的执行单元编号 */
     word Qk;         /* 为零则表示对应的 V 有效 */
     word exTimeLeft; /* 指令执行的剩余时间 */
     word robIdx;     /* 该指令对应的 ROB 项编号 */
+
+    bool operator==(const ResStation& o) const {
+        return busy == o.busy && instr == o.instr && uop == o.uop && Vj == o.Vj && Vk == o.Vk && Qj == o.Qj &&
+               Qk == o.Qk && exTimeLeft == o.exTimeLeft && robIdx == o.robIdx;
+    }
 };
 
 struct ROBEntry {     /* ROB 项的数据结构 */
     bool busy;        /* 空闲标志位 */
     bool valid;       /* 表明结果是否有效的标志位 */
+    bool replay;      /* load 读到的值已被更早的 store 推翻, 提交时需要重新执行 */
     word pc;
     word instr;       /* 指令 */
+    MicroOp uop;      /* 预译码的指令 */
     word execUnit;    /* 执行单元编号 */
     word instrStatus; /* 指令的当前状态 */
     word result;      /* 在提交之前临时存放结果 */
-    word address;     /* store 指令的内存地址, 也用作 `beqz` 的预测地址 */
+    word address;     /* load 与 store 指令的内存地址, 也用作 `beqz` 的预测地址 */
+
+    bool operator==(const ROBEntry& o) const {
+        return busy == o.busy && valid == o.valid && replay == o.replay && pc == o.pc && instr == o.instr &&
+               uop == o.uop && execUnit == o.execUnit && instrStatus == o.instrStatus && result == o.result &&
+               address == o.address;
+    }
 };
 
 struct RegResultEntry { /* 寄存器状态的数据结构 */
     bool valid = true;  /* 1 表示寄存器值有效, 否则 0 */
     word robIdx{};      /* 如果值无效, 记录 ROB 中哪个项目会提交结果 */
+
+    bool operator==(const RegResultEntry& o) const {
+        return valid == o.valid && robIdx == o.robIdx;
+    }
+};
+
+struct BranchCheckpoint {                             /* 分支发射时保存的状态, 用于写回时恢复 */
+    std::array<RegResultEntry, NUMREGS> regResult{}; /* 寄存器重命名表 */
+    uint64_t specHistory = 0;                         /* 分支预测之前的推测历史 */
+
+    bool operator==(const BranchCheckpoint& o) const {
+        return regResult == o.regResult && specHistory == o.specHistory;
+    }
 };
 
 struct BTBEntry {
@@ -115,4 +199,64 @@ struct BTBEntry {
     BHT branchPred; /* 预测: 2-bit 分支历史 */
     word branchPc;  /* 分支指令的 PC 值 */
     word targetPc;  /* when predict taken, update PC with target */
+
+    bool operator==(const BTBEntry& o) const {
+        return valid == o.valid && branchPred == o.branchPred && branchPc == o.branchPc && targetPc == o.targetPc;
+    }
+};
+
+struct Stats {                    /* 统计信息 */
+    uint64_t committed = 0;       /* 已提交的指令数 */
+    uint64_t mispredicts = 0;     /* 分支预测错误的次数 */
+    uint64_t stalls = 0;          /* 因保留栈或 ROB 已满而无法发射的周期数 */
+    uint64_t stallsNoStation = 0; /* 其中没有空闲保留栈的周期数 */
+    uint64_t stallsRobFull = 0;   /* 其中 ROB 已满的周期数 */
+    uint64_t cdbConflicts = 0;    /* 已可写回但公共数据总线已被占满的次数 */
+    uint64_t flushes = 0;         /* 清除错误路径的次数, 包括清空流水线与只清除部分指令 */
+    uint64_t branches = 0;        /* 已提交的分支指令数 */
+    uint64_t cacheHits = 0;       /* 数据缓存命中次数 */
+    uint64_t cacheMisses = 0;     /* 数据缓存缺失次数 */
+    uint64_t cacheWritebacks = 0; /* 替换脏行的次数 */
+    uint64_t replays = 0;         /* 因内存访问顺序错误而重新执行的 load 数 */
+    uint64_t fastForwarded = 0;   /* 快进时功能执行的指令数, 不计入 committed */
+
+    double accuracy() const {
+        //* 分支预测的准确率
+        return branches == 0 ? 0.0 : 1.0 - (double)mispredicts / branches;
+    }
+
+    double hitRate() const {
+        //* 数据缓存的命中率
+        return cacheHits + cacheMisses == 0 ? 0.0 : (double)cacheHits / (cacheHits + cacheMisses);
+    }
+};
+
+/*
+ * 批量运行的停止条件与结果
+ */
+enum StopReason {
+    HALTED = 0,      /* 执行到 halt */
+    BREAKPOINT = 1,  /* PC 到达断点 */
+    WATCHPOINT = 2,  /* 被监视的内存字发生变化 */
+    CYCLE_LIMIT = 3, /* 达到周期上限 */
+    INSTR_LIMIT = 4, /* 快进时达到指令数上限 */
+};
+inline const char* stopreasonname[5] = {"HALTED", "BREAKPOINT", "WATCHPOINT", "CYCLE_LIMIT",
+                                        "INSTR_LIMIT"}; /* 停止原因名称 */
+
+struct StopCondition {
+    word breakPc = INVALID;   /* PC 断点, INVALID 表示不设置 */
+    word watchAddr = INVALID; /* 内存监视点, INVALID 表示不设置 */
+};
+
+struct RunSummary {
+    uint64_t cycles = 0;    /* 本次运行经过的周期数, 快进时为 0 */
+    uint64_t committed = 0; /* 本次运行提交的指令数, 快进时为执行的指令数 */
+    bool halted = false;
+    StopReason reason = CYCLE_LIMIT;
+
+    double ipc() const {
+        //* 每周期提交的指令数
+        return cycles ? double(committed) / cycles : 0;
+    }
 };
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include "defines.hpp"
+#include "error.hpp"
+#include "state.hpp"
+
+/*
+ * 周期历史记录:
+ * 每个周期只记录相对上一周期发生变化的 ROB 项, 保留栈, 寄存器和内存字,
+ * 并周期性地插入完整的关键帧, 以限制回溯时需要重放的增量数量.
+ */
+class History {
+  public:
+    explicit History(const MachineState& initial, word keyframeInterval = 1024)
+        : interval(keyframeInterval == 0 ? 1 : keyframeInterval), last(initial), cursorState(initial) {
+        keyframes.push_back(initial);
+        keyframeBytes += tableBytes(initial);
+        keyframeFrames.push_back(0);
+        frameOffsets.push_back(log.size());
+    }
+
+    void record(const MachineState& state) {
+        //* 记录 `nextStep` 之后的新状态, 游标移动到最新一帧; 增量按表的下标记录, 所以机器参数必须与初始状态相同
+        if (state.config != keyframes.front().config)
+            throw TomasuloError("Recorded state must use the same configuration as the initial state");
+        // 帧号即周期数之差, 所以必须逐周期记录; `run` 或 `fastForward` 跳过的周期无法回溯
+        if (state.cycles != last.cycles + 1)
+            throw TomasuloError("Expected the state of cycle", last.cycles + 1, "got cycle", state.cycles);
+        auto frame = frameOffsets.size();
+        if (sinceKeyframe + 1 >= interval || bytesSinceKeyframe >= stateBytes(state)) {
+            keyframes.push_back(state);
+            keyframeBytes += tableBytes(state);
+            keyframeFrames.push_back(frame);
+            frameOffsets.push_back(log.size());
+            sinceKeyframe = 0;
+            bytesSinceKeyframe = 0;
+        } else {
+            auto begin = log.size();
+            writeDelta(last, state);
+            frameOffsets.push_back(begin);
+            sinceKeyframe += 1;
+            bytesSinceKeyframe += log.size() - begin;
+        }
+        last = state;
+        cursor = frame;
+        cursorState = state;
+    }
+
+    const MachineState& seek(word cycle) {
+        //* 将游标移动到给定周期, 返回该周期的状态
+        auto first = keyframes.front().cycles;
+        if (cycle < first || cycle - first >= frameOffsets.size())
+            throw TomasuloError("Cycle", cycle, "is not recorded");
+        size_t frame = cycle - first;
+        if (frame == cursor)
+            return cursorState;
+        if (frame == cursor + 1) {
+            applyFrame(frame, cursorState);
+        } else {
+            size_t key = nearestKeyframe(frame);
+            cursorState = keyframes[key];
+            for (size_t f = keyframeFrames[key] + 1; f <= frame; ++f) {
+                applyFrame(f, cursorState);
+            }
+        }
+        cursor = frame;
+        return cursorState;
+    }
+
+    const MachineState& stepBack() {
+        //* 回退一个周期
+        if (cursor == 0)
+            throw TomasuloError("Already at the first recorded cycle");
+        return seek(cursorState.cycles - 1);
+    }
+
+    const MachineState& stepForward() {
+        //* 前进一个周期, 只能前进到已经记录过的周期
+        return seek(cursorState.cycles + 1);
+    }
+
+    const MachineState& current() const {
+        return cursorState;
+    }
+
+    const MachineState& latest() const {
+        return last;
+    }
+
+    size_t size() const {
+        //* 已记录的帧数, 包含初始状态
+        return frameOffsets.size();
+    }
+
+    size_t memoryUsage() const {
+        //* 历史记录本身占用的字节数 (近似); 写时复制时关键帧之间共享的页按指针去重, 只计一次
+        std::unordered_set<const Page*> pages{};
+        for (const auto& key : keyframes)
+            key.memory.forEachPage([&](word, const Page& page) { pages.insert(&page); });
+        return keyframeBytes + pages.size() * sizeof(Page) + keyframeFrames.capacity() * sizeof(size_t) +
+               frameOffsets.capacity() * sizeof(size_t) + log.capacity();
+    }
+
+  private:
+    word interval;
+    size_t sinceKeyframe = 0;
+    size_t bytesSinceKeyframe = 0;
+    size_t keyframeBytes = 0; /* 各关键帧除内存页以外的字节数 */
+    size_t cursor = 0;
+    MachineState last;
+    MachineState cursorState;
+    std::vector<MachineState> keyframes{};
+    std::vector<size_t> keyframeFrames{}; /* keyframes[i] 对应的帧号, 递增 */
+    std::vector<size_t> frameOffsets{};   /* 每一帧增量在 log 中的起始位置 */
+    std::vector<unsigned char> log{};
+
+    static size_t tableBytes(const MachineState& state) {
+        //* 一个完整状态除内存页以外大约占用的字节数
+        return sizeof(MachineState) + state.rob.size() * sizeof(ROBEntry) +
+               state.reservation.size() * sizeof(ResStation) + state.btb.size() * sizeof(BTBEntry) +
+               state.btbRepl.size() * sizeof(uint64_t) +
+               state.branchCheckpoints.size() * sizeof(BranchCheckpoint) +
+               state.cache.lines.size() * sizeof(CacheLine) + state.cache.repl.size() * sizeof(uint64_t) +
+               state.waiters.size() * sizeof(uint64_t) + state.robAddress.size() * sizeof(word) +
+               (state.robStores.size() + state.robLoads.size()) * sizeof(uint64_t) +
+               state.predictor.pht.size() + state.predictor.local.size() + state.predictor.chooser.size() +
+               state.predictor.tagged.size() * sizeof(TageEntry) +
+               (state.unitBusy.size() + state.robOccupancy.size()) * sizeof(uint64_t) +
+               state.uops.size() * sizeof(MicroOp);
+    }
+
+    static size_t stateBytes(const MachineState& state) {
+        //* 一个完整状态大约占用的字节数, 用于决定何时插入关键帧
+        return tableBytes(state) + state.memory.pageCount() * sizeof(Page);
+    }
+
+    size_t nearestKeyframe(size_t frame) const {
+        //* 返回不晚于 `frame` 的最近关键帧在 keyframes 中的下标
+        auto it = std::upper_bound(keyframeFrames.begin(), keyframeFrames.end(), frame);
+        return it - keyframeFrames.begin() - 1;
+    }
+
+    template <class T> void put(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto pos = log.size();
+        log.resize(pos + sizeof(T));
+        memcpy(&log[pos], &value, sizeof(T));
+    }
+
+    template <class T> T get(size_t& pos) const {
+        T value;
+        memcpy(&value, &log[pos], sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    template <class Table> void diffTable(const Table& prev, const Table& cur) {
+        /*
+         * 写入 (下标, 新值) 对, 以数量开头; 同一份历史中各表的长度不变.
+         * 含填充字节的结构体逐字段比较, 否则逐项赋值之后内容不确定的填充字节会被当作改变
+         */
+        using T = typename Table::value_type;
+        auto countPos = log.size();
+        put<word>(0);
+        word count = 0;
+        for (word i = 0; i < cur.size(); ++i) {
+            bool same;
+            if constexpr (std::has_unique_object_representations_v<T>)
+                same = memcmp(&prev[i], &cur[i], sizeof(T)) == 0;
+            else
+                same = prev[i] == cur[i];
+            if (!same) {
+                put(i);
+                put(cur[i]);
+                count += 1;
+            }
+        }
+        memcpy(&log[countPos], &count, sizeof(word));
+    }
+
+    void diffMemory(const PagedMemory& prev, const PagedMemory& cur) {
+        /*
+         * 逐页比较, 写时复制时未修改的页与上一帧共享, 比较指针即可跳过.
+         * 页面只会增加, 上一帧没有的页按全零比较.
+         */
+        constexpr word BLOCK = 64;
+        static const Page zero{};
+        auto countPos = log.size();
+        put<word>(0);
+        word count = 0;
+        cur.forEachPage([&](word number, const Page& page) {
+            auto old = prev.findPage(number);
+            if (old == &page)
+                return;
+            if (!old)
+                old = &zero;
+            for (word base = 0; base < PAGEWORDS; base += BLOCK) {
+                if (memcmp(&(*old)[base], &page[base], BLOCK * sizeof(word)) == 0)
+                    continue;
+                for (word i = base; i < base + BLOCK; ++i) {
+                    if ((*old)[i] != page[i]) {
+                        put((number << PAGEBITS) + i);
+                        put(page[i]);
+                        count += 1;
+                    }
+                }
+            }
+        });
+        memcpy(&log[countPos], &count, sizeof(word));
+    }
+
+    template <class Table> void patchTable(size_t& pos, Table& table) const {
+        using T = typename Table::value_type;
+        auto count = get<word>(pos);
+        for (word i = 0; i < count; ++i) {
+            auto idx = get<word>(pos);
+            table[idx] = get<T>(pos);
+        }
+    }
+
+    void patchMemory(size_t& pos, MachineState& state) const {
+        //* 改写的内存可能是代码, 同时使其预译码结果失效
+        auto count = get<word>(pos);
+        for (word i = 0; i < count; ++i) {
+            auto address = get<word>(pos);
+            state.memory.write(address, get<word>(pos));
+            state.invalidateUops(address, 1);
+        }
+    }
+
+    void putList(const std::vector<word>& list) {
+        put<word>(list.size());
+        for (auto value : list) {
+            put(value);
+        }
+    }
+
+    void getList(size_t& pos, std::vector<word>& list) const {
+        list.resize(get<word>(pos));
+        for (auto& value : list) {
+            value = get<word>(pos);
+        }
+    }
+
+    void writeDelta(const MachineState& prev, const MachineState& cur) {
+        put(cur.pc);
+        put(cur.cycles);
+        put(cur.robHeadIdx);
+        put(cur.robTailIdx);
+        put(cur.memorySize);
+        put(cur.stats);
+        put(cur.activeMask);
+        put(cur.predictor.history);
+        put(cur.predictor.specHistory);
+        put(cur.fetchStall);
+        putList(cur.written);
+        diffTable(prev.rob, cur.rob);
+        diffTable(prev.reservation, cur.reservation);
+        diffTable(prev.btb, cur.btb);
+        diffTable(prev.btbRepl, cur.btbRepl);
+        diffTable(prev.regResult, cur.regResult);
+        diffTable(prev.regFile, cur.regFile);
+        diffTable(prev.waiters, cur.waiters);
+        diffTable(prev.robAddress, cur.robAddress);
+        diffTable(prev.robStores, cur.robStores);
+        diffTable(prev.robLoads, cur.robLoads);
+        diffTable(prev.branchCheckpoints, cur.branchCheckpoints);
+        diffTable(prev.predictor.pht, cur.predictor.pht);
+        diffTable(prev.predictor.local, cur.predictor.local);
+        diffTable(prev.predictor.chooser, cur.predictor.chooser);
+        diffTable(prev.predictor.tagged, cur.predictor.tagged);
+        diffTable(prev.cache.lines, cur.cache.lines);
+        diffTable(prev.cache.repl, cur.cache.repl);
+        diffMemory(prev.memory, cur.memory);
+        diffTable(prev.unitBusy, cur.unitBusy);
+        diffTable(prev.robOccupancy, cur.robOccupancy);
+    }
+
+    void applyFrame(size_t frame, MachineState& state) const {
+        //* 将第 `frame` 帧的增量作用到 `state` 上; 关键帧直接覆盖
+        auto key = nearestKeyframe(frame);
+        if (keyframeFrames[key] == frame) {
+            state = keyframes[key];
+            return;
+        }
+        auto pos = frameOffsets[frame];
+        state.pc = get<word>(pos);
+        state.cycles = get<word>(pos);
+        state.robHeadIdx = get<word>(pos);
+        state.robTailIdx = get<word>(pos);
+        state.memorySize = get<word>(pos);
+        state.stats = get<Stats>(pos);
+        state.activeMask = get<uint64_t>(pos);
+        state.predictor.history = get<uint64_t>(pos);
+        state.predictor.specHistory = get<uint64_t>(pos);
+        state.fetchStall = get<word>(pos);
+        getList(pos, state.written);
+        patchTable(pos, state.rob);
+        patchTable(pos, state.reservation);
+        patchTable(pos, state.btb);
+        patchTable(pos, state.btbRepl);
+        patchTable(pos, state.regResult);
+        patchTable(pos, state.regFile);
+        patchTable(pos, state.waiters);
+        patchTable(pos, state.robAddress);
+        patchTable(pos, state.robStores);
+        patchTable(pos, state.robLoads);
+        patchTable(pos, state.branchCheckpoints);
+        patchTable(pos, state.predictor.pht);
+        patchTable(pos, state.predictor.local);
+        patchTable(pos, state.predictor.chooser);
+        patchTable(pos, state.predictor.tagged);
+        patchTable(pos, state.cache.lines);
+        patchTable(pos, state.cache.repl);
+        patchMemory(pos, state);
+        patchTable(pos, state.unitBusy);
+        patchTable(pos, state.robOccupancy);
+    }
+};
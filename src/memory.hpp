@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "config.hpp"
+#include "defines.hpp"
+#include "error.hpp"
+
+constexpr word PAGEBITS = 10;
+constexpr word PAGEWORDS = word(1) << PAGEBITS; /* 每页 1024 字, 即 4 KB */
+
+using Page = std::array<word, PAGEWORDS>;
+
+/*
+ * 页面池:
+ * 每个线程保留一些释放的页面, 以免频繁地分配和释放 4 KB 的内存.
+ * 参数扫描的各个线程各自使用自己的池, 不需要加锁.
+ */
+class PagePool {
+  public:
+    static std::shared_ptr<Page> zeroed() {
+        auto page = acquire();
+        page->fill(0);
+        return wrap(page);
+    }
+
+    static std::shared_ptr<Page> clone(const Page& src) {
+        auto page = acquire();
+        *page = src;
+        return wrap(page);
+    }
+
+  private:
+    static constexpr size_t MAXFREE = 1024; /* 每个线程最多保留的空闲页数 */
+
+    struct FreeList {
+        std::vector<Page*> pages{};
+
+        FreeList() = default;
+        FreeList(const FreeList&) = delete;
+        FreeList& operator=(const FreeList&) = delete;
+
+        ~FreeList() {
+            for (auto page : pages)
+                delete page;
+            destroyed() = true;
+        }
+    };
+
+    static bool& destroyed() {
+        //* 线程退出之后仍可能有页面被释放 (如静态变量), 此时直接 delete
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    static FreeList& freeList() {
+        thread_local FreeList list{};
+        return list;
+    }
+
+    static Page* acquire() {
+        if (destroyed())
+            return new Page;
+        auto& pages = freeList().pages;
+        if (pages.empty())
+            return new Page;
+        auto page = pages.back();
+        pages.pop_back();
+        return page;
+    }
+
+    static void release(Page* page) {
+        if (destroyed() || freeList().pages.size() >= MAXFREE) {
+            delete page;
+            return;
+        }
+        freeList().pages.push_back(page);
+    }
+
+    static std::shared_ptr<Page> wrap(Page* page) {
+        return std::shared_ptr<Page>(page, release);
+    }
+};
+
+/*
+ * 分页的稀疏内存:
+ * 地址以字为单位, memSize 为 0 时可以使用完整的 32 位地址空间.
+ * 页面在第一次写入时才分配, 读取未分配的页面得到 0.
+ * 页表是按页号排序的数组, 程序通常只用到少数几页, 查找很快;
+ * 最低的几页另有直接索引的表, 取指和大多数访存不需要查找.
+ * 打开写时复制时, 复制出的状态与原状态共享页面, 某一方写入时才复制该页;
+ * 关闭时每次复制都会复制所有页面.
+ */
+class PagedMemory {
+  public:
+    PagedMemory() : PagedMemory(MachineConfig{}) {
+    }
+
+    explicit PagedMemory(const MachineConfig& config)
+        : limit(config.memSize ? config.memSize : uint64_t(1) << 32), cow(config.memCopyOnWrite) {
+    }
+
+    PagedMemory(const PagedMemory& other) : limit(other.limit), cow(other.cow), pages(other.pages) {
+        if (!cow)
+            unshare();
+        relink();
+    }
+
+    PagedMemory(PagedMemory&&) = default;
+
+    PagedMemory& operator=(const PagedMemory& other) {
+        if (this != &other) {
+            limit = other.limit;
+            cow = other.cow;
+            pages = other.pages;
+            if (!cow)
+                unshare();
+            relink();
+        }
+        return *this;
+    }
+
+    PagedMemory& operator=(PagedMemory&&) = default;
+
+    uint64_t size() const {
+        //* 可用的字数
+        return limit;
+    }
+
+    size_t pageCount() const {
+        //* 已分配的页数
+        return pages.size();
+    }
+
+    word operator[](word address) const {
+        auto number = address >> PAGEBITS;
+        auto page = number < NUMDIRECT ? direct[number] : findPage(number);
+        return page ? (*page)[address & (PAGEWORDS - 1)] : 0;
+    }
+
+    void write(word address, word value) {
+        writablePage(address >> PAGEBITS)[address & (PAGEWORDS - 1)] = value;
+    }
+
+    void readRange(word address, word* out, word count) const {
+        //* 读取从 `address` 开始的 `count` 个字
+        for (word i = 0; i < count;) {
+            auto offset = (address + i) & (PAGEWORDS - 1);
+            auto len = std::min(count - i, PAGEWORDS - offset);
+            auto page = findPage((address + i) >> PAGEBITS);
+            if (page)
+                std::copy_n(page->data() + offset, len, out + i);
+            else
+                std::fill_n(out + i, len, 0);
+            i += len;
+        }
+    }
+
+    void writeRange(word address, const word* data, word count) {
+        //* 写入从 `address` 开始的 `count` 个字, 调用者保证不越界
+        for (word i = 0; i < count;) {
+            auto offset = (address + i) & (PAGEWORDS - 1);
+            auto len = std::min(count - i, PAGEWORDS - offset);
+            std::copy_n(data + i, len, writablePage((address + i) >> PAGEBITS).data() + offset);
+            i += len;
+        }
+    }
+
+    void writeUnaligned(word address, const char* data, word count) {
+        //* 同 `writeRange`, 但 `data` 不必按字对齐, 逐页用 memcpy 直接复制到目标页中
+        for (word i = 0; i < count;) {
+            auto offset = (address + i) & (PAGEWORDS - 1);
+            auto len = std::min(count - i, PAGEWORDS - offset);
+            auto page = writablePage((address + i) >> PAGEBITS).data();
+            memcpy(page + offset, data + i * sizeof(word), len * sizeof(word));
+            i += len;
+        }
+    }
+
+    void copyPages(const PagedMemory& src) {
+        //* 复制 `src` 的全部内容, 按本内存的设置决定是否共享页面
+        if (!src.pages.empty() && (uint64_t(src.pages.back().number) << PAGEBITS) >= limit)
+            throw TomasuloError("Memory contents do not fit in memory of", limit, "words");
+        pages = src.pages;
+        if (!cow)
+            unshare();
+        relink();
+    }
+
+    const Page* findPage(word number) const {
+        //* 页号为 `number` 的页面, 未分配时返回 nullptr
+        auto it = lowerBound(number);
+        return it != pages.end() && it->number == number ? it->page.get() : nullptr;
+    }
+
+    std::shared_ptr<const Page> sharedPage(word number) const {
+        //* 同 `findPage`, 但与调用者共享该页; 之后本内存写入该页时会先复制, 调用者看到的内容不变
+        auto it = lowerBound(number);
+        return it != pages.end() && it->number == number ? it->page : nullptr;
+    }
+
+    template <class F> void forEachPage(F&& f) const {
+        //* 按页号递增的顺序以 (页号, 页面) 访问已分配的页
+        for (const auto& entry : pages)
+            f(entry.number, *entry.page);
+    }
+
+  private:
+    struct Entry {
+        word number;                  /* 页号 */
+        std::shared_ptr<Page> page{}; /* 写时复制时可能与其他状态共享 */
+    };
+
+    static constexpr word NUMDIRECT = 16; /* 直接索引的页数 */
+
+    uint64_t limit;
+    bool cow;
+    std::vector<Entry> pages{};                   /* 按页号排序 */
+    std::array<const Page*, NUMDIRECT> direct{}; /* 低页号的页面, 不持有所有权 */
+
+    std::vector<Entry>::const_iterator lowerBound(word number) const {
+        return std::lower_bound(pages.begin(), pages.end(), number,
+                                [](const Entry& entry, word n) { return entry.number < n; });
+    }
+
+    Page& writablePage(word number) {
+        //* 第一次写入时分配页面, 与其他状态共享时先复制一份
+        auto it = pages.begin() + (lowerBound(number) - pages.cbegin());
+        if (it == pages.end() || it->number != number)
+            it = pages.insert(it, {number, PagePool::zeroed()});
+        else if (it->page.use_count() > 1)
+            it->page = PagePool::clone(*it->page);
+        if (number < NUMDIRECT)
+            direct[number] = it->page.get();
+        return *it->page;
+    }
+
+    void unshare() {
+        for (auto& entry : pages)
+            entry.page = PagePool::clone(*entry.page);
+    }
+
+    void relink() {
+        //* 页表改变之后重建直接索引的表
+        direct.fill(nullptr);
+        for (auto& entry : pages)
+            if (entry.number < NUMDIRECT)
+                direct[entry.number] = entry.page.get();
+    }
+};
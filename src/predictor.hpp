@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "config.hpp"
+#include "defines.hpp"
+
+inline BHT newBHT(BHT old, bool taken) {
+    if (taken) {
+        if (old == BHT::STRONGTAKEN) {
+            return BHT::STRONGTAKEN;
+        } else {
+            return BHT(old + 1);
+        }
+    } else {
+        if (old == BHT::STRONGNOT) {
+            return BHT::STRONGNOT;
+        } else {
+            return BHT(old - 1);
+        }
+    }
+}
+
+struct TageEntry {  /* TAGE 带标签表项 */
+    uint8_t tag;    /* 部分标签 */
+    int8_t ctr;     /* 3-bit 有符号饱和计数器, 非负表示预测跳转 */
+    uint8_t useful; /* 2-bit 有用计数, 为零时才可被替换 */
+};
+
+constexpr word NUMTAGE = 4;                                    /* TAGE 带标签表的数量 */
+constexpr std::array<word, NUMTAGE> TAGEHISTORY{4, 8, 16, 32}; /* 各表使用的历史长度 */
+constexpr word TAGETAGBITS = 8;                                /* 部分标签的位数 */
+
+/*
+ * 分支方向预测器:
+ * 分支目标仍然来自分支预测缓冲栈, 只有命中时才会按预测的方向跳转.
+ * BIMODAL 直接使用缓冲栈中每项的 2-bit 计数器, 其他预测器使用这里的表.
+ * 发射时按预测方向推测地移入历史, 提交时再以实际方向更新已提交的历史,
+ * 冲刷流水线时推测历史恢复为已提交的历史, 写回时恢复则使用分支检查点中的历史.
+ * 两种情况下, 一条分支提交时的已提交历史都恰好等于它被预测时的推测历史,
+ * 因此训练与预测使用同一个索引.
+ * 所有状态都放在定长的表里, 以便复制, 记录历史和保存检查点.
+ */
+class BranchPredictor {
+  public:
+    BranchPredictor() : BranchPredictor(MachineConfig{}) {
+    }
+
+    explicit BranchPredictor(const MachineConfig& config)
+        : kind(config.predictor), phtBits(config.phtBits), historyBits(config.historyBits) {
+        switch (kind) {
+        case GSHARE:
+            pht.assign(size_t(1) << phtBits, BHT::WEAKNOT);
+            break;
+        case TOURNAMENT:
+            pht.assign(size_t(1) << phtBits, BHT::WEAKNOT);
+            local.assign(size_t(1) << phtBits, BHT::WEAKNOT);
+            chooser.assign(size_t(1) << phtBits, BHT::WEAKNOT);
+            break;
+        case TAGE:
+            pht.assign(size_t(1) << phtBits, BHT::WEAKNOT);
+            tagged.assign(NUMTAGE << tageBits(), TageEntry{0, -1, 0});
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool predict(word pc) const {
+        //* 以推测历史预测 `pc` 处的分支是否跳转, BIMODAL 不使用此函数
+        switch (kind) {
+        case GSHARE:
+            return taken(pht[gshareIdx(pc, specHistory)]);
+        case TOURNAMENT:
+            return taken(chooser[localIdx(pc)]) ? taken(pht[gshareIdx(pc, specHistory)])
+                                                : taken(local[localIdx(pc)]);
+        case TAGE:
+            return tageLookup(pc, specHistory).pred;
+        default:
+            return false;
+        }
+    }
+
+    void speculate(bool isTaken) {
+        //* 发射一条分支后, 将其预测方向移入推测历史
+        specHistory = specHistory << 1 | uint64_t(isTaken);
+    }
+
+    void recover() {
+        //* 冲刷流水线时丢弃推测历史
+        specHistory = history;
+    }
+
+    void recover(uint64_t hist) {
+        //* 只清除部分指令时, 推测历史恢复为出错分支之前的历史加上它的实际方向
+        specHistory = hist;
+    }
+
+    void update(word pc, bool isTaken) {
+        //* 分支提交时以实际方向训练预测器并更新已提交的历史
+        switch (kind) {
+        case GSHARE:
+            pht[gshareIdx(pc, history)] = newBHT(BHT(pht[gshareIdx(pc, history)]), isTaken);
+            break;
+        case TOURNAMENT: {
+            auto& global = pht[gshareIdx(pc, history)];
+            auto& bimodal = local[localIdx(pc)];
+            if (taken(global) != taken(bimodal)) {
+                auto& choice = chooser[localIdx(pc)];
+                choice = newBHT(BHT(choice), taken(global) == isTaken);
+            }
+            global = newBHT(BHT(global), isTaken);
+            bimodal = newBHT(BHT(bimodal), isTaken);
+            break;
+        }
+        case TAGE:
+            updateTage(pc, isTaken);
+            break;
+        default:
+            return;
+        }
+        history = history << 1 | uint64_t(isTaken);
+    }
+
+    word kind;                       /* 预测器种类, 见 `PredictorKind` */
+    word phtBits;                    /* 计数器表的索引位数 */
+    word historyBits;                /* gshare 使用的全局历史长度 */
+    uint64_t history = 0;            /* 已提交的全局历史, 最低位为最近一次分支 */
+    uint64_t specHistory = 0;        /* 包含尚未提交分支的推测历史 */
+    std::vector<uint8_t> pht{};      /* gshare 表; TAGE 的基础预测表 */
+    std::vector<uint8_t> local{};    /* tournament 中以 pc 索引的 bimodal 表 */
+    std::vector<uint8_t> chooser{};  /* tournament 选择器, 偏向跳转时选择 gshare */
+    std::vector<TageEntry> tagged{}; /* TAGE 的各张带标签表, 依次连续存放 */
+
+  private:
+    struct TageLookup {
+        int provider = -1; /* 命中的最长历史表, -1 表示使用基础表 */
+        bool pred = false;
+        bool altPred = false;
+        std::array<word, NUMTAGE> idx{};
+        std::array<uint8_t, NUMTAGE> tag{};
+    };
+
+    static bool taken(uint8_t counter) {
+        return counter >= BHT::WEAKTAKEN;
+    }
+
+    static word fold(uint64_t value, word length, word bits) {
+        //* 取 `value` 的低 `length` 位, 按 `bits` 位一段异或折叠
+        if (length < 64)
+            value &= (uint64_t(1) << length) - 1;
+        word ret = 0;
+        for (; value; value >>= bits)
+            ret ^= word(value & ((uint64_t(1) << bits) - 1));
+        return ret;
+    }
+
+    word mask() const {
+        return (word(1) << phtBits) - 1;
+    }
+
+    word localIdx(word pc) const {
+        return pc & mask();
+    }
+
+    word gshareIdx(word pc, uint64_t hist) const {
+        return (pc ^ fold(hist, historyBits, phtBits)) & mask();
+    }
+
+    word tageBits() const {
+        return phtBits - 2;
+    }
+
+    TageLookup tageLookup(word pc, uint64_t hist) const {
+        TageLookup ret{};
+        auto bits = tageBits();
+        for (word t = 0; t < NUMTAGE; t++) {
+            ret.idx[t] = (pc ^ (pc >> bits) ^ fold(hist, TAGEHISTORY[t], bits)) & ((word(1) << bits) - 1);
+            ret.tag[t] = uint8_t(pc ^ fold(hist, TAGEHISTORY[t], TAGETAGBITS) ^
+                                 (fold(hist, TAGEHISTORY[t], TAGETAGBITS - 1) << 1));
+        }
+        bool base = taken(pht[localIdx(pc)]);
+        ret.pred = ret.altPred = base;
+        for (int t = NUMTAGE - 1; t >= 0; t--) {
+            auto& entry = tagged[(word(t) << bits) + ret.idx[t]];
+            if (entry.tag != ret.tag[t])
+                continue;
+            if (ret.provider < 0) {
+                ret.provider = t;
+                ret.pred = entry.ctr >= 0;
+            } else {
+                ret.altPred = entry.ctr >= 0;
+                break;
+            }
+        }
+        return ret;
+    }
+
+    void updateTage(word pc, bool isTaken) {
+        auto lookup = tageLookup(pc, history);
+        auto bits = tageBits();
+        auto entryOf = [&](word t) -> TageEntry& { return tagged[(t << bits) + lookup.idx[t]]; };
+        if (lookup.provider >= 0) {
+            auto& entry = entryOf(lookup.provider);
+            if (lookup.pred != lookup.altPred)
+                entry.useful = lookup.pred == isTaken ? std::min(entry.useful + 1, 3) : std::max(entry.useful - 1, 0);
+            entry.ctr = isTaken ? std::min(entry.ctr + 1, 3) : std::max(entry.ctr - 1, -4);
+        } else {
+            auto& counter = pht[localIdx(pc)];
+            counter = newBHT(BHT(counter), isTaken);
+        }
+        if (lookup.pred == isTaken)
+            return;
+        // 预测错误时在更长历史的表中分配新项, 全都有用时降低它们的有用计数
+        bool allocated = false;
+        for (word t = lookup.provider + 1; t < NUMTAGE && !allocated; t++) {
+            if (entryOf(t).useful == 0) {
+                entryOf(t) = {lookup.tag[t], int8_t(isTaken ? 0 : -1), 0};
+                allocated = true;
+            }
+        }
+        if (!allocated)
+            for (word t = lookup.provider + 1; t < NUMTAGE; t++)
+                entryOf(t).useful = std::max(entryOf(t).useful - 1, 0);
+    }
+};
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "defines.hpp"
+#include "error.hpp"
+#include "simpoint.hpp"
+#include "state.hpp"
+#include "sweep.hpp"
+#include "trace.hpp"
+
+// 不依赖 Python 的命令行模拟器
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [options] <program>\n"
+            "       %s [options] --restore <checkpoint>\n"
+            "       %s --dump-trace <trace>\n"
+            "\n"
+            "  <program>            binary produced by scripts/assembler.py\n"
+            "  --words              read <program> as whitespace separated words (decimal or 0x-prefixed)\n"
+            "  --asm                read <program> as assembly source, as accepted by scripts/assembler.py\n"
+            "  --config <file>      load machine geometry and latencies from <file>\n"
+            "  --json               print the final state as JSON instead of the `printState` format\n"
+            "  --stats              also print the performance counters\n"
+            "  --max-cycles <n>     stop after <n> cycles if the program does not halt\n"
+            "  --fast-forward <n>   execute the first <n> instructions functionally before simulating timing\n"
+            "  --until-pc <pc>      fast-forward until the instruction at <pc> is reached\n"
+            "  --no-warmup          do not train the BTB, branch predictor and cache while fast-forwarding\n"
+            "  --restore <file>     resume from a checkpoint instead of loading <program>\n"
+            "  --save <file>        write a checkpoint of the final state to <file>\n"
+            "  --sweep <file>       run once per `[name]` section of <file> and print a table of the results\n"
+            "  --simpoint <n>       estimate the CPI by simulating representative intervals of <n> instructions\n"
+            "  --clusters <k>       maximum number of interval clusters for --simpoint, defaults to 10\n"
+            "  --samples <n>        intervals simulated per cluster for --simpoint, defaults to 3\n"
+            "  --max-instrs <n>     stop --simpoint profiling after <n> instructions if the program does not halt\n"
+            "  --threads <n>        worker threads for --sweep and --simpoint, defaults to the number of cores\n"
+            "  --trace <file>       write a binary trace of pipeline events to <file>\n"
+            "  --dump-trace <file>  print the events of a trace written by --trace, one per line\n",
+            prog, prog, prog);
+}
+
+static std::string readFile(const char* path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin)
+        throw TomasuloError("Cannot open", path);
+    return std::string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+static std::vector<word> readWords(const char* path) {
+    std::ifstream fin(path);
+    if (!fin)
+        throw TomasuloError("Cannot open", path);
+    std::vector<word> words{};
+    std::string token{};
+    while (fin >> token) {
+        char* end = nullptr;
+        auto value = strtoull(token.c_str(), &end, 0);
+        if (*end != '\0' || value > UINT32_MAX)
+            throw TomasuloError("Invalid word", token, "in", path);
+        words.push_back((word)value);
+    }
+    return words;
+}
+
+static bool parseNumber(const char* text, uint64_t limit, uint64_t& value) {
+    //* 解析命令行参数中的非负整数, 可带 0x 或 0 前缀; 格式错误, 溢出或超过 `limit` 时返回 false
+    char* end = nullptr;
+    errno = 0;
+    value = strtoull(text, &end, 0);
+    return isdigit((unsigned char)text[0]) && *end == '\0' && errno == 0 && value <= limit;
+}
+
+enum ProgramFormat { BINARY, WORDS, ASM };
+
+static MachineState loadProgram(const char* path, ProgramFormat format, const MachineConfig& config) {
+    MachineState state{config};
+    if (format == ASM) {
+        state.loadProgram(readFile(path), path);
+    } else if (format == WORDS) {
+        auto words = readWords(path);
+        state.loadImage(words.data(), words.size());
+    } else {
+        state.loadBinary(readFile(path));
+    }
+    return state;
+}
+
+static void dumpTrace(const char* path) {
+    TraceReader reader{path};
+    std::vector<TraceRecord> records(TRACE_BUFFER);
+    printf("%10s  %-9s %6s %5s %10s %10s\n", "cycle", "event", "rob", "unit", "pc", "value");
+    while (auto count = reader.read(records.data(), records.size())) {
+        for (size_t i = 0; i < count; i++) {
+            auto& rec = records[i];
+            auto name = rec.event < NUMTRACEEVENTS ? traceeventname[rec.event] : "?";
+            printf("%10u  %-9s %6u %5u %10u %10u\n", rec.cycle, name, rec.robIdx, rec.unit, rec.pc, rec.value);
+        }
+    }
+}
+
+static void printSweep(const std::vector<std::pair<std::string, MachineConfig>>& sections,
+                       const std::vector<SweepResult>& results, bool json) {
+    if (json) {
+        printf("[\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            auto& r = results[i];
+            printf("  {\"name\": \"%s\", \"cycles\": %llu, \"committed\": %llu, \"ipc\": %.4f, "
+                   "\"branches\": %llu, \"mispredicts\": %llu, \"accuracy\": %.4f, \"stalls\": %llu, "
+                   "\"cacheHits\": %llu, \"cacheMisses\": %llu, \"halted\": %s, \"error\": \"%s\"}%s\n",
+                   sections[i].first.c_str(), (unsigned long long)r.cycles, (unsigned long long)r.committed, r.ipc(),
+                   (unsigned long long)r.branches, (unsigned long long)r.mispredicts, r.accuracy(), (unsigned long long)r.stalls,
+                   (unsigned long long)r.cacheHits, (unsigned long long)r.cacheMisses, r.halted ? "true" : "false",
+                   r.error.c_str(), i + 1 < results.size() ? "," : "");
+        }
+        printf("]\n");
+        return;
+    }
+    printf("%-16s %12s %12s %8s %12s %9s %12s %9s  %s\n", "config", "cycles", "committed", "IPC", "mispredicts",
+           "accuracy", "stalls", "hit rate", "status");
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        auto status = !r.error.empty() ? "error: " + r.error : r.halted ? std::string("halted") : "cycle limit";
+        printf("%-16s %12llu %12llu %8.4f %12llu %9.4f %12llu %9.4f  %s\n", sections[i].first.c_str(),
+               (unsigned long long)r.cycles, (unsigned long long)r.committed, r.ipc(),
+               (unsigned long long)r.mispredicts, r.accuracy(), (unsigned long long)r.stalls, r.hitRate(),
+               status.c_str());
+    }
+}
+
+static void printSimPoint(const SimPointResult& r, bool json) {
+    std::vector<word> sizes(r.clusters), counts(r.clusters);
+    std::vector<double> sums(r.clusters);
+    for (auto label : r.labels)
+        sizes[label] += 1;
+    for (auto& sample : r.samples) {
+        counts[sample.cluster] += 1;
+        sums[sample.cluster] += sample.cpi();
+    }
+    auto share = r.instructions ? 100.0 * r.detailed / r.instructions : 0.0;
+    if (json) {
+        printf("{\"interval\": %llu, \"intervals\": %zu, \"instructions\": %llu, \"truncated\": %s, ",
+               (unsigned long long)r.interval, r.labels.size(), (unsigned long long)r.instructions,
+               r.truncated ? "true" : "false");
+        printf("\"detailed\": %llu, \"cpi\": %.4f, ", (unsigned long long)r.detailed, r.cpi);
+        if (std::isnan(r.cpiError))
+            printf("\"cpiError\": null, ");
+        else
+            printf("\"cpiError\": %.4f, ", r.cpiError);
+        printf("\"ipc\": %.4f, \"clusters\": [", r.ipc());
+        for (word c = 0; c < r.clusters; c++)
+            printf("%s{\"weight\": %.4f, \"intervals\": %u, \"samples\": %u, \"cpi\": %.4f}", c ? ", " : "",
+                   r.weights[c], sizes[c], counts[c], sums[c] / counts[c]);
+        printf("], \"samples\": [");
+        for (size_t i = 0; i < r.samples.size(); i++) {
+            auto& s = r.samples[i];
+            printf("%s{\"interval\": %llu, \"cluster\": %u, \"cycles\": %llu, \"committed\": %llu}", i ? ", " : "",
+                   (unsigned long long)s.interval, s.cluster, (unsigned long long)s.cycles,
+                   (unsigned long long)s.committed);
+        }
+        printf("]}\n");
+        return;
+    }
+    printf("%llu instructions in %zu intervals of %llu, %u clusters%s\n", (unsigned long long)r.instructions,
+           r.labels.size(), (unsigned long long)r.interval, r.clusters,
+           r.truncated ? " (instruction limit reached before halt)" : "");
+    printf("%8s %9s %10s %8s %9s\n", "cluster", "weight", "intervals", "samples", "CPI");
+    for (word c = 0; c < r.clusters; c++)
+        printf("%8u %9.4f %10u %8u %9.4f\n", c, r.weights[c], sizes[c], counts[c], sums[c] / counts[c]);
+    if (std::isnan(r.cpiError))
+        printf("CPI: %.4f (IPC %.4f), error unknown with one sample per cluster\n", r.cpi, r.ipc());
+    else
+        printf("CPI: %.4f +- %.4f (95%%), IPC %.4f\n", r.cpi, r.cpiError, r.ipc());
+    printf("Detailed: %llu instructions (%.2f%%)\n", (unsigned long long)r.detailed, share);
+}
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    const char* configPath = nullptr;
+    const char* sweepPath = nullptr;
+    const char* restorePath = nullptr;
+    const char* savePath = nullptr;
+    const char* tracePath = nullptr;
+    const char* dumpPath = nullptr;
+    unsigned threads = 0;
+    bool json = false;
+    bool counters = false;
+    ProgramFormat format = BINARY;
+    uint64_t maxCycles = UINT64_MAX;
+    uint64_t skipInstrs = 0;
+    StopCondition skipUntil{};
+    SimPointOptions simpointOptions{};
+    bool sampled = false;
+    bool warmup = true;
+    const char* badNumber = nullptr;
+    auto number = [&](const char* text, uint64_t limit) {
+        uint64_t value = 0;
+        if (!parseNumber(text, limit, value) && !badNumber)
+            badNumber = text;
+        return value;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            counters = true;
+        } else if (!strcmp(argv[i], "--words")) {
+            format = WORDS;
+        } else if (!strcmp(argv[i], "--asm")) {
+            format = ASM;
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            configPath = argv[++i];
+        } else if (!strcmp(argv[i], "--sweep") && i + 1 < argc) {
+            sweepPath = argv[++i];
+        } else if (!strcmp(argv[i], "--restore") && i + 1 < argc) {
+            restorePath = argv[++i];
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (!strcmp(argv[i], "--dump-trace") && i + 1 < argc) {
+            dumpPath = argv[++i];
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)number(argv[++i], UINT_MAX);
+        } else if (!strcmp(argv[i], "--max-cycles") && i + 1 < argc) {
+            maxCycles = number(argv[++i], UINT64_MAX);
+        } else if (!strcmp(argv[i], "--fast-forward") && i + 1 < argc) {
+            skipInstrs = number(argv[++i], UINT64_MAX);
+        } else if (!strcmp(argv[i], "--until-pc") && i + 1 < argc) {
+            skipUntil.breakPc = (word)number(argv[++i], UINT32_MAX);
+            if (skipInstrs == 0)
+                skipInstrs = UINT64_MAX;
+        } else if (!strcmp(argv[i], "--simpoint") && i + 1 < argc) {
+            simpointOptions.interval = number(argv[++i], UINT64_MAX);
+            sampled = true;
+        } else if (!strcmp(argv[i], "--clusters") && i + 1 < argc) {
+            simpointOptions.clusters = (word)number(argv[++i], UINT32_MAX);
+        } else if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            simpointOptions.samples = (word)number(argv[++i], UINT32_MAX);
+        } else if (!strcmp(argv[i], "--max-instrs") && i + 1 < argc) {
+            simpointOptions.maxInstructions = number(argv[++i], UINT64_MAX);
+        } else if (!strcmp(argv[i], "--no-warmup")) {
+            warmup = false;
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (badNumber) {
+        fprintf(stderr, "error: invalid number '%s'\n", badNumber);
+        usage(argv[0]);
+        return 1;
+    }
+    if (dumpPath) {
+        try {
+            dumpTrace(dumpPath);
+            return 0;
+        } catch (const TomasuloError& e) {
+            fprintf(stderr, "error: %s\n", e.what());
+            return 1;
+        }
+    }
+    if (!path == !restorePath || (restorePath && configPath) || (tracePath && sweepPath) ||
+        (skipInstrs && sweepPath) ||
+        (sampled && (sweepPath || tracePath || savePath || skipInstrs))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        auto config = configPath ? MachineConfig::fromFile(configPath) : MachineConfig{};
+        auto state = restorePath ? loadCheckpoint(restorePath) : loadProgram(path, format, config);
+        auto memorySize = state.memorySize;
+
+        if (sweepPath) {
+            auto sections = MachineConfig::sectionsFromFile(sweepPath);
+            std::vector<MachineConfig> configs{};
+            for (auto& section : sections)
+                configs.push_back(section.second);
+            auto results = sweep(state, configs, maxCycles, threads);
+            printSweep(sections, results, json);
+            return std::all_of(results.begin(), results.end(), [](auto& r) { return r.error.empty(); }) ? 0 : 1;
+        }
+
+        if (sampled) {
+            printSimPoint(simpoint(state, simpointOptions, threads), json);
+            return 0;
+        }
+
+        if (skipInstrs)
+            state.fastForward(skipInstrs, skipUntil, warmup);
+        if (tracePath)
+            state.startTrace(tracePath);
+        auto summary = state.run(maxCycles);
+        state.stopTrace();
+        if (savePath)
+            saveCheckpoint(state, savePath);
+        if (json) {
+            printStateJson(&state, memorySize, &summary, counters);
+        } else {
+            printState(&state, memorySize);
+            if (counters)
+                printCounters(&state);
+        }
+        return summary.halted ? 0 : 2;
+    } catch (const TomasuloError& e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+}
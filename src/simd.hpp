@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOMASULO_X86 1
+#else
+#define TOMASULO_X86 0
+#endif
+
+#include "defines.hpp"
+
+/*
+ * 按列存放的表上的向量比较:
+ * `matchWords(data, count, key)` 返回 data[0, count) 中等于 key 的各项的位图, count 不超过 64.
+ * x86 上在运行时按 CPU 支持的指令集选择 AVX2 或 SSE2 的实现, 其他平台使用标量实现.
+ * 各实现用 target 属性单独编译, 不需要以 -mavx2 编译整个程序.
+ */
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+};
+inline const char* simdlevelname[3] = {"scalar", "sse2", "avx2"}; /* 指令集名称 */
+constexpr word NUMSIMDLEVELS = 3;
+
+using MatchKernel = uint64_t (*)(const word* data, word count, word key);
+
+inline uint64_t matchWordsScalar(const word* data, word count, word key) {
+    uint64_t bits = 0;
+    for (word i = 0; i < count; i++)
+        bits |= uint64_t(data[i] == key) << i;
+    return bits;
+}
+
+#if TOMASULO_X86
+__attribute__((target("sse2"))) inline uint64_t matchWordsSSE2(const word* data, word count, word key) {
+    auto k = _mm_set1_epi32((int)key);
+    uint64_t bits = 0;
+    word i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i)), k);
+        bits |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(eq))) << i;
+    }
+    for (; i < count; i++)
+        bits |= uint64_t(data[i] == key) << i;
+    return bits;
+}
+
+__attribute__((target("avx2"))) inline uint64_t matchWordsAVX2(const word* data, word count, word key) {
+    auto k = _mm256_set1_epi32((int)key);
+    uint64_t bits = 0;
+    word i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), k);
+        bits |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) << i;
+    }
+    for (; i < count; i++)
+        bits |= uint64_t(data[i] == key) << i;
+    return bits;
+}
+#endif
+
+inline SimdLevel supportedSimd() {
+    //* 当前 CPU 支持的最高指令集
+#if TOMASULO_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+inline MatchKernel matchKernel(SimdLevel level) {
+    switch (level) {
+#if TOMASULO_X86
+    case SIMD_AVX2:
+        return matchWordsAVX2;
+    case SIMD_SSE2:
+        return matchWordsSSE2;
+#endif
+    default:
+        return matchWordsScalar;
+    }
+}
+
+inline SimdLevel simdLevel = supportedSimd();             /* 正在使用的指令集 */
+inline MatchKernel matchWords = matchKernel(simdLevel); /* 程序启动时按 CPU 选定 */
+
+inline SimdLevel setSimdLevel(SimdLevel level) {
+    /*
+     * 改用不高于 `level` 的实现, 用于比较各实现的结果与性能, 返回实际使用的指令集.
+     * 与正在运行的模拟不同步, 应在开始模拟之前调用.
+     */
+    auto supported = supportedSimd();
+    simdLevel = level < supported ? level : supported;
+    matchWords = matchKernel(simdLevel);
+    return simdLevel;
+}
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "defines.hpp"
+#include "error.hpp"
+#include "state.hpp"
+#include "sweep.hpp"
+
+/*
+ * SimPoint 式的抽样模拟:
+ * 1. 功能执行整个程序, 每 `interval` 条指令记录一个基本块向量, 即各基本块执行的指令数占区间的比例;
+ *    基本块以末尾的分支或跳转指令的 pc 标识, 向量随机投影到 BBV_DIMS 维.
+ * 2. 用 k-means 将各区间聚类, 同一类中的区间执行相同的代码, 性能也相近.
+ * 3. 每类选出离中心最近的区间, 以及另外至多 samples - 1 个随机的区间, 从功能执行的快照开始详细模拟.
+ * 4. 按各类所含指令数的比例加权各类的平均 CPI; 把各类看作分层抽样的层, 由类内样本的方差给出误差界.
+ */
+constexpr word BBV_DIMS = 15; /* 投影之后的维数, 与 SimPoint 相同 */
+using BBV = std::array<double, BBV_DIMS>;
+
+struct BBVProfile {                  /* 功能执行得到的各区间的基本块向量 */
+    uint64_t interval = 0;           /* 每个区间的指令数 */
+    uint64_t total = 0;              /* 执行的总指令数 */
+    std::vector<BBV> vectors{};      /* 归一化并投影之后的向量 */
+    std::vector<uint64_t> lengths{}; /* 各区间的指令数, 只有最后一个可能不足 interval */
+    bool truncated = false;          /* 达到指令数上限时程序尚未停机 */
+};
+
+struct SimPointOptions {
+    uint64_t interval = 100000;            /* 区间的指令数 */
+    word clusters = 10;                    /* k-means 的类数上限, 不同的向量较少时会更少 */
+    word samples = 3;                      /* 每类详细模拟的区间数, 至少 2 个时才能估计误差 */
+    uint64_t warmup = 10000;               /* 每个区间之前详细模拟但不计入结果的指令数, 用于填满流水线 */
+    uint64_t seed = 1;                     /* 聚类与抽样的随机种子 */
+    uint64_t maxInstructions = UINT64_MAX; /* 功能执行的指令数上限, 程序不停机时只剖析到这里 */
+};
+
+struct SimPointSample {     /* 一个详细模拟的区间 */
+    uint64_t interval = 0;  /* 区间的下标 */
+    word cluster = 0;       /* 所属的类 */
+    uint64_t cycles = 0;    /* 区间内经过的周期数 */
+    uint64_t committed = 0; /* 区间内提交的指令数 */
+
+    double cpi() const {
+        return committed == 0 ? 0.0 : (double)cycles / committed;
+    }
+};
+
+struct SimPointResult {
+    uint64_t interval = 0;                /* 区间的指令数 */
+    uint64_t instructions = 0;            /* 程序的总指令数 */
+    word clusters = 0;                    /* 实际的类数 */
+    std::vector<word> labels{};           /* 各区间所属的类 */
+    std::vector<double> weights{};        /* 各类所含指令数占总数的比例 */
+    std::vector<SimPointSample> samples{}; /* 按区间的先后顺序 */
+    uint64_t detailed = 0;                /* 详细模拟的指令数, 包括预热 */
+    double cpi = 0.0;                     /* 加权的 CPI 估计 */
+    double cpiError = 0.0;                /* 95% 置信区间的半宽, 无法估计时为 NaN */
+    bool truncated = false;               /* 程序在 maxInstructions 条指令内没有停机, 只估计了这一段 */
+
+    double ipc() const {
+        return cpi == 0.0 ? 0.0 : 1.0 / cpi;
+    }
+};
+
+inline double bbvProjection(word pc, word dim) {
+    //* 基本块 `pc` 在第 `dim` 维上的投影系数, 在 [-1, 1) 中均匀分布; 由 splitmix64 从 pc 算出, 不需要保存投影矩阵
+    uint64_t z = (uint64_t(pc) * BBV_DIMS + dim) + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return double(z >> 11) * 0x1.0p-52 - 1.0;
+}
+
+inline BBVProfile profileBBV(MachineState state, uint64_t interval, uint64_t maxInstrs = UINT64_MAX) {
+    //* 从 `state` 开始功能执行到 halt 或 `maxInstrs` 条指令, 返回每 `interval` 条指令的基本块向量
+    if (interval == 0)
+        throw TomasuloError("SimPoint interval must be positive");
+    BBVProfile profile{};
+    profile.interval = interval;
+    std::vector<uint64_t> counts(state.memorySize + 1); /* 下标为基本块末尾的 pc, 本区间执行的指令数 */
+    std::vector<word> touched{};                         /* 本区间执行过的基本块 */
+    auto record = [&](word pc, uint64_t length) {
+        if (counts[pc] == 0)
+            touched.push_back(pc);
+        counts[pc] += length;
+    };
+    while (profile.total < maxInstrs) {
+        uint64_t last = 0;
+        auto limit = std::min(interval, maxInstrs - profile.total);
+        auto summary = state.fastForwardBlocks(limit, {}, false, [&](word pc, uint64_t count) {
+            record(pc, count - last);
+            last = count;
+        });
+        if (summary.committed == 0)
+            break;
+        // 区间末尾未结束的基本块以停下时的 pc 标识
+        if (summary.committed > last)
+            record(std::min(state.pc, state.memorySize), summary.committed - last);
+        BBV vec{};
+        for (auto pc : touched) {
+            auto share = (double)counts[pc] / summary.committed;
+            for (word d = 0; d < BBV_DIMS; d++)
+                vec[d] += share * bbvProjection(pc, d);
+            counts[pc] = 0;
+        }
+        touched.clear();
+        profile.vectors.push_back(vec);
+        profile.lengths.push_back(summary.committed);
+        profile.total += summary.committed;
+        if (summary.reason != INSTR_LIMIT)
+            break;
+    }
+    profile.truncated = profile.total >= maxInstrs;
+    return profile;
+}
+
+inline double distance2(const BBV& a, const BBV& b) {
+    double sum = 0.0;
+    for (word d = 0; d < BBV_DIMS; d++)
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    return sum;
+}
+
+struct KMeansResult {
+    std::vector<BBV> centroids{};
+    std::vector<word> labels{}; /* 各点所属的类 */
+    double sse = 0.0;           /* 各点到所属中心的距离平方和 */
+};
+
+inline KMeansResult kmeansOnce(const std::vector<BBV>& points, word k, std::mt19937_64& rng) {
+    /*
+     * k-means++ 选取初始中心, 再以 Lloyd 算法迭代至收敛.
+     * 剩余的点都与已选的中心重合时不再增加中心, 所以类数可能少于 `k`.
+     */
+    auto n = points.size();
+    KMeansResult result{};
+    std::vector<double> nearest(n, std::numeric_limits<double>::infinity());
+    result.centroids.push_back(points[std::uniform_int_distribution<size_t>(0, n - 1)(rng)]);
+    while (result.centroids.size() < k) {
+        double total = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            nearest[i] = std::min(nearest[i], distance2(points[i], result.centroids.back()));
+            total += nearest[i];
+        }
+        if (total == 0.0)
+            break;
+        auto pick = std::uniform_real_distribution<double>(0.0, total)(rng);
+        size_t i = 0;
+        for (; i + 1 < n && pick >= nearest[i]; i++)
+            pick -= nearest[i];
+        result.centroids.push_back(points[i]);
+    }
+
+    k = (word)result.centroids.size();
+    result.labels.assign(n, 0);
+    for (word iter = 0; iter < 100; iter++) {
+        bool changed = iter == 0;
+        for (size_t i = 0; i < n; i++) {
+            word best = 0;
+            for (word c = 1; c < k; c++)
+                if (distance2(points[i], result.centroids[c]) < distance2(points[i], result.centroids[best]))
+                    best = c;
+            changed = changed || best != result.labels[i];
+            result.labels[i] = best;
+        }
+        if (!changed)
+            break;
+        std::vector<BBV> sums(k);
+        std::vector<size_t> sizes(k);
+        for (size_t i = 0; i < n; i++) {
+            auto c = result.labels[i];
+            sizes[c] += 1;
+            for (word d = 0; d < BBV_DIMS; d++)
+                sums[c][d] += points[i][d];
+        }
+        for (word c = 0; c < k; c++) {
+            // 空的类保留原来的中心, 下一轮仍可能分到点
+            if (sizes[c] != 0)
+                for (word d = 0; d < BBV_DIMS; d++)
+                    result.centroids[c][d] = sums[c][d] / sizes[c];
+        }
+    }
+    for (size_t i = 0; i < n; i++)
+        result.sse += distance2(points[i], result.centroids[result.labels[i]]);
+    return result;
+}
+
+inline KMeansResult kmeans(const std::vector<BBV>& points, word k, uint64_t seed, word restarts = 5) {
+    //* 以不同的初始中心运行 `restarts` 次, 取距离平方和最小的一次; 去掉空的类并按首次出现的顺序重新编号
+    if (points.empty() || k == 0)
+        return {};
+    std::mt19937_64 rng(seed);
+    KMeansResult best{};
+    for (word r = 0; r < restarts; r++) {
+        auto result = kmeansOnce(points, k, rng);
+        if (r == 0 || result.sse < best.sse)
+            best = std::move(result);
+    }
+    std::vector<word> renumber(best.centroids.size(), INVALID);
+    std::vector<BBV> centroids{};
+    for (auto& label : best.labels) {
+        if (renumber[label] == INVALID) {
+            renumber[label] = (word)centroids.size();
+            centroids.push_back(best.centroids[label]);
+        }
+        label = renumber[label];
+    }
+    best.centroids = std::move(centroids);
+    return best;
+}
+
+inline void runUntilCommitted(MachineState& state, uint64_t target) {
+    //* 详细模拟直到共提交 `target` 条指令或 halt
+    while (state.stats.committed < target && !state.nextStep()) {
+    }
+}
+
+inline SimPointResult simpoint(const MachineState& program, const SimPointOptions& options = {},
+                               unsigned threads = 0) {
+    //* 从 `program` 开始抽样模拟, 各样本区间在线程池上并行地详细模拟
+    if (options.samples == 0)
+        throw TomasuloError("SimPoint needs at least one sample per cluster");
+    auto profile = profileBBV(program, options.interval, options.maxInstructions);
+    auto km = kmeans(profile.vectors, options.clusters, options.seed);
+
+    SimPointResult result{};
+    result.interval = options.interval;
+    result.instructions = profile.total;
+    result.truncated = profile.truncated;
+    result.clusters = (word)km.centroids.size();
+    result.labels = km.labels;
+    result.weights.assign(result.clusters, 0.0);
+    std::vector<std::vector<uint64_t>> members(result.clusters);
+    for (uint64_t i = 0; i < profile.lengths.size(); i++) {
+        result.weights[km.labels[i]] += (double)profile.lengths[i] / profile.total;
+        members[km.labels[i]].push_back(i);
+    }
+
+    // 每类先选离中心最近的区间, 其余样本从剩下的区间中随机选取
+    std::mt19937_64 rng(options.seed);
+    for (word c = 0; c < result.clusters; c++) {
+        auto& list = members[c];
+        auto closest = std::min_element(list.begin(), list.end(), [&](uint64_t a, uint64_t b) {
+            return distance2(profile.vectors[a], km.centroids[c]) < distance2(profile.vectors[b], km.centroids[c]);
+        });
+        std::iter_swap(list.begin(), closest);
+        std::shuffle(list.begin() + 1, list.end(), rng);
+        for (size_t s = 0; s < std::min<size_t>(options.samples, list.size()); s++)
+            result.samples.push_back({list[s], c});
+    }
+    std::sort(result.samples.begin(), result.samples.end(),
+              [](const SimPointSample& a, const SimPointSample& b) { return a.interval < b.interval; });
+
+    // 再次功能执行, 一路预热分支预测与缓存, 在每个样本的预热起点保存快照
+    std::vector<MachineState> snapshots{};
+    std::vector<uint64_t> warmups{};
+    snapshots.reserve(result.samples.size());
+    MachineState state{program};
+    uint64_t position = 0;
+    for (auto& sample : result.samples) {
+        auto start = sample.interval * options.interval;
+        auto from = start > options.warmup ? start - options.warmup : 0;
+        if (from > position)
+            position += state.fastForward(from - position).committed;
+        snapshots.push_back(state);
+        warmups.push_back(start - position);
+    }
+
+    std::vector<std::exception_ptr> errors(result.samples.size());
+    parallelFor(result.samples.size(), threads, [&](size_t i) {
+        try {
+            auto& machine = snapshots[i];
+            auto& sample = result.samples[i];
+            machine.drainPipeline();
+            runUntilCommitted(machine, machine.stats.committed + warmups[i]);
+            auto cycles = machine.cycles;
+            auto committed = machine.stats.committed;
+            runUntilCommitted(machine, committed + profile.lengths[sample.interval]);
+            sample.cycles = machine.cycles - cycles;
+            sample.committed = machine.stats.committed - committed;
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    });
+    for (auto& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+
+    /*
+     * 分层抽样的估计: CPI = sum(w_c * mean_c), Var = sum(w_c^2 * (1 - n_c / N_c) * s_c^2 / n_c).
+     * 只有一个样本的类 (且类中还有其他区间) 没有样本方差, 使用其他类合并的相对方差.
+     */
+    std::vector<double> sum(result.clusters), sumSq(result.clusters);
+    std::vector<uint64_t> count(result.clusters);
+    for (size_t i = 0; i < result.samples.size(); i++) {
+        auto& sample = result.samples[i];
+        result.detailed += warmups[i] + sample.committed;
+        sum[sample.cluster] += sample.cpi();
+        sumSq[sample.cluster] += sample.cpi() * sample.cpi();
+        count[sample.cluster] += 1;
+    }
+    double pooled = 0.0;
+    uint64_t dof = 0;
+    for (word c = 0; c < result.clusters; c++) {
+        auto mean = sum[c] / count[c];
+        result.cpi += result.weights[c] * mean;
+        if (count[c] >= 2 && mean > 0.0) {
+            auto var = std::max(0.0, (sumSq[c] - count[c] * mean * mean) / (count[c] - 1));
+            pooled += var / (mean * mean) * (count[c] - 1);
+            dof += count[c] - 1;
+        }
+    }
+    double variance = 0.0;
+    bool known = true;
+    for (word c = 0; c < result.clusters; c++) {
+        auto n = (double)count[c];
+        auto size = (double)members[c].size();
+        if (n >= size)
+            continue; // 整类都已模拟, 没有抽样误差
+        auto mean = sum[c] / n;
+        double var = 0.0;
+        if (count[c] >= 2)
+            var = std::max(0.0, (sumSq[c] - n * mean * mean) / (n - 1));
+        else if (dof > 0)
+            var = pooled / dof * mean * mean;
+        else
+            known = false;
+        variance += result.weights[c] * result.weights[c] * (1.0 - n / size) * var / n;
+    }
+    result.cpiError = known ? 1.96 * std::sqrt(variance) : std::numeric_limits<double>::quiet_NaN();
+    return result;
+}
@@ -1,48 +1,137 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
 #include <iostream>
-#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "assembler.hpp"
+#include "cache.hpp"
+#include "config.hpp"
 #include "decode.hpp"
 #include "defines.hpp"
 #include "error.hpp"
+#include "memory.hpp"
+#include "predictor.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
 
-template <class F> inline word randBy(F&& f) {
-    static thread_local auto gen = std::mt19937_64{};
-    return f(gen);
-}
+struct MachineState {
+    MachineConfig config{}; /* 机器参数, 构造之后不再改变 */
+    word pc = 16;           /* PC */
+    word cycles = 0;        /* 已经过的周期数 */
+    word robHeadIdx = 0;    /* 循环队列的头指针 */
+    word robTailIdx = 0;    /* 循环队列的尾指针 */
+    word memorySize = 0;
+    Stats stats{};
+    std::vector<uint64_t> unitBusy{};     /* 下标为执行单元, 保留栈忙碌的周期数 */
+    std::vector<uint64_t> robOccupancy{}; /* 下标为 ROB 中的指令数, 处于该占用的周期数 */
+    std::vector<ROBEntry> rob{};                     /* ROB */
+    std::vector<ResStation> reservation{};           /* 保留栈, 下标为执行单元编号 */
+    std::vector<BTBEntry> btb{};                     /* 分支预测缓冲栈, 同一组的各路连续存放 */
+    std::vector<uint64_t> btbRepl{};                 /* 分支预测缓冲栈每组的替换状态 */
+    word btbWays;                                    /* 以下由 config 导出, 避免每次查找都做除法 */
+    word btbSetMask;
+    word btbTagShift;
+    word btbTagMask;
+    BranchPredictor predictor;                       /* 分支方向预测器 */
+    DataCache cache;                                 /* L1 数据缓存, 只影响 load 与 store 的延迟 */
+    std::array<RegResultEntry, NUMREGS> regResult{}; /* 寄存器状态 */
+    PagedMemory memory;                              /* 内存, 按页稀疏地分配 */
+    std::vector<MicroOp> uops{};                     /* 预译码缓存, 下标为 pc, 改写代码所在的内存时失效 */
+    std::array<word, NUMREGS> regFile{};             /* 寄存器 */
 
-inline BHT newBHT(BHT old, bool taken) {
-    if (taken) {
-        if (old == BHT::STRONGTAKEN) {
-            return BHT::STRONGTAKEN;
-        } else {
-            return BHT(old + 1);
-        }
-    } else {
-        if (old == BHT::STRONGNOT) {
-            return BHT::STRONGNOT;
-        } else {
-            return BHT(old - 1);
-        }
+    /*
+     * 唤醒用的位图, 使每个周期只需访问真正相关的保留栈和 ROB 项
+     */
+    std::vector<uint64_t> waiters{}; /* waiters[unit]: 等待 unit 结果的保留栈 */
+    uint64_t activeMask = 0;         /* 尚未写回结果的保留栈 */
+    std::vector<word> written{};     /* 上一周期写回结果的 ROB 项 */
+
+    /*
+     * ROB 中 load/store 队列的按列索引, 使按地址查找可以逐块向量比较:
+     * 位图每 64 项一个字, 只含已写回的 load 与 store; 不在位图中的项, 其地址列没有意义.
+     */
+    std::vector<word> robAddress{};    /* 下标为 ROB 项, 已写回的 load/store 的地址 */
+    std::vector<uint64_t> robStores{}; /* 已写回的 store */
+    std::vector<uint64_t> robLoads{};  /* 已写回的 load */
+
+    std::vector<BranchCheckpoint> branchCheckpoints{}; /* 下标为分支的 ROB 项, 仅在写回时恢复才使用 */
+    word fetchStall = 0;                               /* 重定向之后还需停止发射的周期数 */
+    TraceHook trace{};                                 /* 流水线事件的跟踪, 未打开时为空 */
+
+    MachineState() : MachineState(MachineConfig{}) {
     }
-}
 
-struct MachineState {
-    word pc = 16;        /* PC */
-    word cycles = 0;     /* 已经过的周期数 */
-    word robHeadIdx = 0; /* 循环队列的头指针 */
-    word robTailIdx = 0; /* 循环队列的尾指针 */
-    word memorySize = 0;
-    std::array<ROBEntry, ROBSIZE> rob{};                /* ROB */
-    std::array<ResStation, NUMUNITS + 1> reservation{}; /* 保留栈 */
-    std::array<BTBEntry, BTBSIZE> btb{};                /* 分支预测缓冲栈 */
-    std::array<RegResultEntry, NUMREGS> regResult{};    /* 寄存器状态 */
-    std::array<word, MEMSIZE> memory{};                 /* 内存   */
-    std::array<word, NUMREGS> regFile{};                /* 寄存器 */
+    explicit MachineState(const MachineConfig& cfg)
+        : config(validated(cfg)), unitBusy(cfg.numUnits() + 1), robOccupancy(cfg.robSize), rob(cfg.robSize),
+          reservation(cfg.numUnits() + 1), btb(cfg.btbSize),
+          btbRepl(cfg.btbSets(), initialRepl(cfg)), btbWays(cfg.btbAssoc()), btbSetMask(cfg.btbSets() - 1),
+          btbTagShift(__builtin_ctz(cfg.btbSets())),
+          btbTagMask(cfg.btbTagBits == 0 || cfg.btbTagBits == 32 ? ~word(0) : (word(1) << cfg.btbTagBits) - 1),
+          predictor(cfg), cache(cfg), memory(cfg), waiters(cfg.numUnits() + 1),
+          robAddress(cfg.robSize), robStores((cfg.robSize + 63) / 64), robLoads((cfg.robSize + 63) / 64),
+          branchCheckpoints(cfg.branchRecovery == WRITEBACK ? cfg.robSize : 0) {
+    }
+
+    static const MachineConfig& validated(const MachineConfig& cfg) {
+        cfg.validate();
+        return cfg;
+    }
+
+    static uint64_t initialRepl(const MachineConfig& cfg) {
+        //* LRU 的初始次序为各路的编号, PLRU 的方向位全部为 0
+        uint64_t repl = 0;
+        if (cfg.btbReplacement == LRU)
+            for (word w = 0; w < cfg.btbAssoc(); w++)
+                repl |= uint64_t(w) << (4 * w);
+        return repl;
+    }
+
+    static constexpr uint64_t bit(word idx) {
+        return uint64_t(1) << idx;
+    }
+
+    word robAge(word robIdx) const {
+        //* ROB 项距离队头的距离, 越小越早发射
+        return robIdx >= robHeadIdx ? robIdx - robHeadIdx : robIdx + config.robSize - robHeadIdx;
+    }
+
+    word robNext(word robIdx) const {
+        //* 循环队列中的下一项, 避免对运行时的 ROB 大小取模
+        return robIdx + 1 == config.robSize ? 0 : robIdx + 1;
+    }
+
+    word robPrev(word robIdx) const {
+        return robIdx == 0 ? config.robSize - 1 : robIdx - 1;
+    }
+
+    void traceEvent(TraceEvent event, word robIdx, word unit, word pc, word value) {
+        //* 打开跟踪时记录一个事件, 未打开时只多一次判断
+        if (__builtin_expect(trace.writer != nullptr, 0))
+            trace.writer->push({cycles, uint8_t(event), uint8_t(unit), uint16_t(robIdx), pc, value});
+    }
+
+    void startTrace(const std::string& path) {
+        //* 开始把流水线事件写入 `path`, 已打开的跟踪会先关闭
+        if (config.robSize > 65536)
+            throw TomasuloError("Tracing requires robSize <= 65536, got", config.robSize);
+        stopTrace();
+        trace.writer = std::make_unique<TraceWriter>(path);
+    }
+
+    void stopTrace() {
+        //* 写完所有记录并关闭跟踪文件
+        if (auto writer = std::move(trace.writer))
+            writer->close();
+    }
 
     void broadcastUpdate(word unit, word value) {
         /*
@@ -50,9 +139,8 @@ struct MachineState {
          * 将位于公共数据总线上的数据
          * 复制到正在等待它的其他保留栈中去
          */
-        for (auto& reserv : reservation) {
-            if (!reserv.busy)
-                continue;
+        for (auto mask = waiters[unit]; mask; mask &= mask - 1) {
+            auto& reserv = reservation[__builtin_ctzll(mask)];
             if (reserv.Qj == unit) {
                 reserv.Vj = value;
                 reserv.Qj = READY;
@@ -62,11 +150,11 @@ struct MachineState {
                 reserv.Qk = READY;
             }
         }
-        for (auto& robEntry : rob) {
-            if (robEntry.busy && !robEntry.valid && robEntry.execUnit == unit) {
-                robEntry.result = value;
-                robEntry.valid = true;
-            }
+        waiters[unit] = 0;
+        auto& robEntry = rob[reservation[unit].robIdx];
+        if (robEntry.busy && !robEntry.valid && robEntry.execUnit == unit) {
+            robEntry.result = value;
+            robEntry.valid = true;
         }
     }
 
@@ -77,6 +165,92 @@ struct MachineState {
         for (auto& robEntry : rob) {
             robEntry = {};
         }
+        written.clear();
+        std::fill(robStores.begin(), robStores.end(), 0);
+        std::fill(robLoads.begin(), robLoads.end(), 0);
+    }
+
+    void clearLsq(word robIdx) {
+        //* 将一项移出 load/store 队列的索引
+        robStores[robIdx / 64] &= ~bit(robIdx % 64);
+        robLoads[robIdx / 64] &= ~bit(robIdx % 64);
+    }
+
+    void rebuildLsqIndex() {
+        //* 由 ROB 重建 load/store 队列的索引, 用于直接恢复了 ROB 的场合
+        std::fill(robStores.begin(), robStores.end(), 0);
+        std::fill(robLoads.begin(), robLoads.end(), 0);
+        for (word idx = 0; idx < rob.size(); ++idx) {
+            const auto& entry = rob[idx];
+            if (!entry.valid || (entry.uop.op != SW && entry.uop.op != LW))
+                continue;
+            robAddress[idx] = entry.address;
+            (entry.uop.op == SW ? robStores : robLoads)[idx / 64] |= bit(idx % 64);
+        }
+    }
+
+    void rebuildRobIndex() {
+        //* 检查直接恢复的 ROB 并重建预译码结果与 load/store 队列的索引, 字段无效时抛出 TomasuloError
+        for (word idx = 0; idx < rob.size(); ++idx) {
+            auto& entry = rob[idx];
+            entry.uop = predecode(entry.instr);
+            if (!entry.busy)
+                continue;
+            if (entry.uop.op == ILLEGAL_OP || entry.execUnit == READY || entry.execUnit > config.numUnits() ||
+                entry.instrStatus > COMMITTING)
+                throw TomasuloError("Inconsistent ROB entry", idx);
+        }
+        rebuildLsqIndex();
+    }
+
+    void rebuildReservationIndex() {
+        /*
+         * 检查直接恢复的保留栈并重建预译码结果, activeMask 与 waiters, 字段无效时抛出 TomasuloError.
+         * store 保留栈只在提交时占用, 操作数已经就绪, 也不在 activeMask 中
+         */
+        auto numUnits = config.numUnits();
+        std::fill(waiters.begin(), waiters.end(), 0);
+        activeMask = 0;
+        for (word unit = 1; unit <= numUnits; ++unit) {
+            auto& reserv = reservation[unit];
+            reserv.uop = predecode(reserv.instr);
+            if (!reserv.busy)
+                continue;
+            if (reserv.uop.op == ILLEGAL_OP || reserv.robIdx >= config.robSize || reserv.Qj > numUnits ||
+                reserv.Qk > numUnits || (config.isStore(unit) && (reserv.Qj != READY || reserv.Qk != READY)))
+                throw TomasuloError("Inconsistent reservation station", config.unitName(unit));
+            if (config.isStore(unit))
+                continue;
+            activeMask |= bit(unit);
+            if (reserv.Qj != READY)
+                waiters[reserv.Qj] |= bit(unit);
+            if (reserv.Qk != READY)
+                waiters[reserv.Qk] |= bit(unit);
+        }
+    }
+
+    void checkBtb() const {
+        /*
+         * 检查直接恢复的分支预测缓冲栈, 无效时抛出 TomasuloError:
+         * 各项的历史应为 BHT 的四个状态之一; LRU 每组应为各路次序的排列, PLRU 只使用树节点 1 .. ways - 1 的方向位
+         */
+        for (word idx = 0; idx < btb.size(); ++idx)
+            if ((unsigned)btb[idx].branchPred > STRONGTAKEN)
+                throw TomasuloError("Inconsistent BTB entry", idx);
+        for (word set = 0; set < btbRepl.size(); ++set) {
+            auto repl = btbRepl[set];
+            bool ok = true;
+            if (config.btbReplacement == LRU) {
+                uint64_t seen = 0;
+                for (word w = 0; w < btbWays; ++w)
+                    seen |= bit((repl >> (4 * w)) & 0xf);
+                ok = seen == bit(btbWays) - 1 && (btbWays == 16 || repl >> (4 * btbWays) == 0);
+            } else {
+                ok = (repl & ~(btbWays == 64 ? ~uint64_t(1) : bit(btbWays) - 2)) == 0;
+            }
+            if (!ok)
+                throw TomasuloError("Inconsistent BTB replacement state in set", set);
+        }
     }
 
     void resetReserve() {
@@ -84,6 +258,10 @@ struct MachineState {
         for (auto& reservEntry : reservation) {
             reservEntry = {};
         }
+        for (auto& mask : waiters) {
+            mask = 0;
+        }
+        activeMask = 0;
     }
 
     void resetRegResult() {
@@ -93,6 +271,144 @@ struct MachineState {
         }
     }
 
+    void readOperand(word reg, word unit, word& V, word& Q) {
+        //* 读取源操作数: 寄存器有效时直接读取, 否则从 ROB 中取结果, 或者等待对应的执行单元
+        const auto& rg = regResult[reg];
+        if (rg.valid) {
+            Q = READY;
+            V = regFile[reg];
+            return;
+        }
+        const auto& rgRob = rob[rg.robIdx];
+        if (rgRob.valid) {
+            Q = READY;
+            V = rgRob.result;
+        } else {
+            Q = rgRob.execUnit;
+            waiters[Q] |= bit(unit);
+        }
+    }
+
+    template <OperandKind KIND> void readSource(const MicroOp& uop, word pc, word unit, word& V, word& Q) {
+        //* 按特性表读取一个源操作数, 不使用的操作数为 0 且立即就绪
+        if constexpr (KIND == OPND_RS1) {
+            readOperand(uop.rs1, unit, V, Q);
+        } else if constexpr (KIND == OPND_RS2) {
+            readOperand(uop.rs2, unit, V, Q);
+        } else {
+            Q = READY;
+            V = KIND == OPND_NEXTPC ? pc + 1 : 0;
+        }
+    }
+
+    template <LatencyClass LAT> word opLatency() const {
+        if constexpr (LAT == LAT_LOAD)
+            return config.loadExec;
+        else if constexpr (LAT == LAT_BRANCH)
+            return config.branchExec;
+        else
+            return config.intExec;
+    }
+
+    /*
+     * 按操作码特化的发射, 写回与提交: 行为在编译时由 `OPTRAITS` 中的字段决定,
+     * 运行时经 `opHandlers` 的函数指针表一次分派, 不再在各阶段按操作码逐级分支.
+     */
+    struct OpHandlers {
+        void (*issue)(MachineState& state, word pc, word unit, word robIdx); /* 读取源操作数, 改写目的寄存器的状态 */
+        word (*result)(MachineState& state, word unit);                      /* 执行完毕时写回的结果 */
+        void (*commit)(MachineState& state, word robIdx);                    /* 提交 */
+    };
+
+    template <word OP> static void issueOp(MachineState& state, word pc, word unit, word robIdx) {
+        constexpr auto traits = OPTRAITS[OP];
+        auto& reservEntry = state.reservation[unit];
+        const auto& uop = reservEntry.uop;
+        reservEntry.exTimeLeft = state.opLatency<traits.latency>();
+        // 先读取源操作数, 再改写目的寄存器的状态, 以免源和目的是同一个寄存器
+        state.readSource<traits.vj>(uop, pc, unit, reservEntry.Vj, reservEntry.Qj);
+        state.readSource<traits.vk>(uop, pc, unit, reservEntry.Vk, reservEntry.Qk);
+        if constexpr (traits.dest != FIELD_NONE)
+            state.regResult[uop.rd] = RegResultEntry{false, robIdx};
+    }
+
+    template <word OP> static word resultOp(MachineState& state, word unit) {
+        constexpr auto alu = OPTRAITS[OP].alu;
+        const auto& reserv = state.reservation[unit];
+        if constexpr (alu == ALU_FUNC)
+            return aluFunc(reserv.uop.imm, reserv.Vj, reserv.Vk);
+        else if constexpr (alu == ALU_ADD_IMM)
+            return reserv.Vj + reserv.uop.imm;
+        else if constexpr (alu == ALU_AND_IMM)
+            return reserv.Vj & reserv.uop.imm;
+        else if constexpr (alu == ALU_LOAD)
+            return state.loadValue(reserv.robIdx, reserv.Vj + reserv.uop.imm);
+        else if constexpr (alu == ALU_VJ)
+            return reserv.Vj;
+        else if constexpr (alu == ALU_VK)
+            return reserv.Vk;
+        else if constexpr (alu == ALU_IMM)
+            return reserv.uop.imm;
+        else
+            return 0;
+    }
+
+    template <word OP> static void commitOp(MachineState& state, word robIdx) {
+        constexpr auto traits = OPTRAITS[OP];
+        auto& robEntry = state.rob[robIdx];
+        if constexpr (OP == LW) {
+            if (robEntry.replay) {
+                state.stats.replays += 1;
+                state.flushPipeline(robEntry.pc);
+                return;
+            }
+        }
+        if constexpr (traits.control == CTRL_BRANCH) {
+            state.commitBranch(robIdx);
+        } else if constexpr (OP == SW) {
+            state.commitStore(robIdx);
+        } else {
+            if constexpr (traits.dest != FIELD_NONE) {
+                auto rd = robEntry.uop.rd;
+                if (state.regResult[rd].robIdx == robIdx)
+                    state.regResult[rd] = {};
+                state.regFile[rd] = robEntry.result;
+            }
+            state.retire(robIdx);
+            state.robPop();
+        }
+    }
+
+    static void issueIllegal(MachineState& state, word pc, word, word) {
+        throw TomasuloError("Invalid instruction", state.memory[pc], "at pc=", pc);
+    }
+
+    static word resultIllegal(MachineState&, word) {
+        return 0;
+    }
+
+    static void commitIllegal(MachineState& state, word robIdx) {
+        state.retire(robIdx);
+        state.robPop();
+    }
+
+    template <word OP> static constexpr OpHandlers handlersFor() {
+        if constexpr (OPTRAITS[OP].valid)
+            return {&issueOp<OP>, &resultOp<OP>, &commitOp<OP>};
+        else
+            return {&issueIllegal, &resultIllegal, &commitIllegal};
+    }
+
+    template <size_t... OPS> static constexpr std::array<OpHandlers, 256> makeOpHandlers(std::index_sequence<OPS...>) {
+        return {{handlersFor<OPS>()...}};
+    }
+
+    static const OpHandlers& opHandlers(word op) {
+        //* 以 `MicroOp::op` 为下标的处理函数表, 编译时生成
+        static constexpr auto table = makeOpHandlers(std::make_index_sequence<256>{});
+        return table[op];
+    }
+
     void issueInstr(word pc, word unit, word robIdx) {
         /*
          * 发射指令:
@@ -103,154 +419,101 @@ struct MachineState {
          * 对于 sw 指令, 如果寄存器有效, 将寄存器中的内存基地址保存在 Vj 中;
          * 对于 beqz 和 j 指令, 将当前 PC+1 的值保存在 Vk 字段中.
          * 如果指令在提交时会修改寄存器的值, 还需要在这里更新寄存器状态数据结构.
+         * 与操作码有关的部分见 `issueOp`.
          */
         auto instr = memory[pc];
-        auto op = opcode(instr);
+        const auto& uop = fetchUop(pc);
+        auto op = uop.op;
         auto& reservEntry = reservation[unit];
         auto& robEntry = rob[robIdx];
         reservEntry.busy = true;
         reservEntry.robIdx = robIdx;
         reservEntry.instr = instr;
+        reservEntry.uop = uop;
         robEntry.busy = true;
         robEntry.instr = instr;
+        robEntry.uop = uop;
         robEntry.instrStatus = ISSUING;
         robEntry.execUnit = unit;
         robEntry.pc = pc;
+        activeMask |= bit(unit);
 
-        word exTimeLeft = 0;
-        switch (op) {
-        case NOOP:
-        case HALT:
-            reservEntry.exTimeLeft = INTEXEC;
-            return;
-        case RR_ALU:
-        case ADDI:
-        case ANDI:
-        case J:
-        case SW:
-            exTimeLeft = INTEXEC;
-            break;
-        case LW:
-            exTimeLeft = LDEXEC;
-            break;
-        case BEQZ:
-            exTimeLeft = BRANCHEXEC;
-            break;
-        default:
-            throw TomasuloError("Invalid op:", op, "at pc=", pc);
-        }
-        reservEntry.exTimeLeft = exTimeLeft;
-
-        switch (op) {
-        case RR_ALU: {
-            auto rs1 = reg1(instr);
-            auto rs2 = reg2(instr);
-            auto rd = reg3(instr);
+        opHandlers(op).issue(*this, pc, unit, robIdx);
+    }
 
-            auto rg1 = regResult[rs1];
-            auto rg2 = regResult[rs2];
+    word btbSet(word branchPc) const {
+        //* 分支所在的组, 组数为 2 的幂
+        return branchPc & btbSetMask;
+    }
 
-            auto& rg3 = regResult[rd];
-            rg3.valid = false;
-            rg3.robIdx = robIdx;
+    word btbFind(word set, word branchPc) const {
+        //* 在组内按标签查找分支, 返回路号, 未命中时返回 INVALID; 使用部分标签时, 不同的分支可能互相混淆
+        auto entries = &btb[set * btbWays];
+        if (config.btbTagBits == 0) {
+            for (word w = 0; w < btbWays; ++w)
+                if (entries[w].valid && entries[w].branchPc == branchPc)
+                    return w;
+        } else {
+            auto tag = (branchPc >> btbTagShift) & btbTagMask;
+            for (word w = 0; w < btbWays; ++w)
+                if (entries[w].valid && ((entries[w].branchPc >> btbTagShift) & btbTagMask) == tag)
+                    return w;
+        }
+        return INVALID;
+    }
 
-            if (rg1.valid) {
-                reservEntry.Qj = READY;
-                reservEntry.Vj = regFile[rs1];
-            } else {
-                const auto& rg1Rob = rob[rg1.robIdx];
-                if (rg1Rob.valid) {
-                    reservEntry.Qj = READY;
-                    reservEntry.Vj = rg1Rob.result;
-                } else {
-                    reservEntry.Qj = rg1Rob.execUnit;
-                }
-            }
-            if (rg2.valid) {
-                reservEntry.Qk = READY;
-                reservEntry.Vk = regFile[rs2];
-            } else {
-                const auto& rg2Rob = rob[rg2.robIdx];
-                if (rg2Rob.valid) {
-                    reservEntry.Qk = READY;
-                    reservEntry.Vk = rg2Rob.result;
-                } else {
-                    reservEntry.Qk = rg2Rob.execUnit;
-                }
-            }
-            break;
-        }
-        case LW:
-        case SW:
-        case ADDI:
-        case ANDI:
-        case BEQZ: {
-            auto rs1 = reg1(instr);
-            auto rd = reg2(instr);
-
-            auto rg1 = regResult[rs1];
-            auto& rg2 = regResult[rd];
-            switch (op) {
-            case LW:
-            case ADDI:
-            case ANDI:
-            case BEQZ: {
-                rg2.valid = false;
-                rg2.robIdx = robIdx;
-                if (rg1.valid) {
-                    reservEntry.Qj = READY;
-                    reservEntry.Vj = regFile[rs1];
-                } else {
-                    const auto& rg1Rob = rob[rg1.robIdx];
-                    if (rg1Rob.valid) {
-                        reservEntry.Qj = READY;
-                        reservEntry.Vj = rg1Rob.result;
-                    } else {
-                        reservEntry.Qj = rg1Rob.execUnit;
-                    }
-                }
-                break;
-            }
-            case SW: {
-                if (rg1.valid) {
-                    reservEntry.Qj = READY;
-                    reservEntry.Vj = regFile[rs1];
-                } else {
-                    const auto& rg1Rob = rob[rg1.robIdx];
-                    if (rg1Rob.valid) {
-                        reservEntry.Qj = READY;
-                        reservEntry.Vj = rg1Rob.result;
-                    } else {
-                        reservEntry.Qj = rg1Rob.execUnit;
-                    }
-                }
-                if (rg2.valid) {
-                    reservEntry.Qk = READY;
-                    reservEntry.Vk = regFile[rd];
-                } else {
-                    const auto& rg2Rob = rob[rg2.robIdx];
-                    if (rg2Rob.valid) {
-                        reservEntry.Qk = READY;
-                        reservEntry.Vk = rg2Rob.result;
-                    } else {
-                        reservEntry.Qk = rg2Rob.execUnit;
-                    }
-                }
-                break;
+    void btbTouch(word set, word way) {
+        /*
+         * 将组内的一路标记为最近使用:
+         * LRU 的状态为每路 4 bit 的次序, 0 表示最近使用;
+         * PLRU 的状态为二叉树各节点的方向位, 指向下一次应替换的一侧.
+         */
+        auto& repl = btbRepl[set];
+        auto ways = btbWays;
+        if (config.btbReplacement == LRU) {
+            auto rank = (repl >> (4 * way)) & 0xf;
+            if (rank == 0)
+                return;
+            for (word w = 0; w < ways; w++) {
+                auto r = (repl >> (4 * w)) & 0xf;
+                if (r < rank)
+                    repl += uint64_t(1) << (4 * w);
             }
-            default:
-                __builtin_unreachable();
+            repl &= ~(uint64_t(0xf) << (4 * way));
+        } else {
+            word node = 1;
+            for (auto level = ways >> 1; level > 0; level >>= 1) {
+                bool right = way & level;
+                if (right)
+                    repl &= ~bit(node);
+                else
+                    repl |= bit(node);
+                node = node * 2 + right;
             }
-            break;
-        }
-        case J: {
-            reservEntry.Qk = READY;
-            reservEntry.Vk = pc + 1;
-            break;
         }
-        default:
+    }
+
+    word btbVictim(word set) const {
+        //* 选择组内被替换的一路, 优先使用编号最大的空闲路
+        auto base = set * btbWays;
+        auto ways = btbWays;
+        for (word w = ways; w-- > 0;)
+            if (!btb[base + w].valid)
+                return w;
+        auto repl = btbRepl[set];
+        if (config.btbReplacement == LRU) {
+            for (word w = 0; w < ways; w++)
+                if (((repl >> (4 * w)) & 0xf) == ways - 1)
+                    return w;
             __builtin_unreachable();
         }
+        word node = 1, way = 0;
+        for (auto level = ways >> 1; level > 0; level >>= 1) {
+            bool right = repl & bit(node);
+            way |= right ? level : 0;
+            node = node * 2 + right;
+        }
+        return way;
     }
 
     void updateBTB(word branchPc, word targetPc, bool taken) {
@@ -258,33 +521,30 @@ struct MachineState {
          * 更新分支预测缓冲栈: 检查是否与缓冲栈中的项目匹配.
          * 如果是, 对 2-bit 的历史记录进行更新;
          * 如果不是, 将当前的分支语句添加到缓冲栈中去.
-         * 如果缓冲栈已满，你需要选择一种替换算法将旧的记录替换出去.
+         * 缓冲栈按 PC 组相联, 只需检查所在组内的各路,
+         * 组内已满时按 LRU 或 PLRU 替换, 结果是确定的.
          * 如果当前跳转成功, 将初始的历史状态设置为 STRONGTAKEN;
          * 如果不成功, 将历史设置为 STRONGNOT
          */
-        size_t victimIdx = -1;
-        for (size_t i = 0; i < btb.size(); ++i) {
-            auto& entry = btb[i];
-            if (entry.valid) {
-                if (entry.branchPc == branchPc && entry.targetPc == targetPc) {
-                    entry.branchPred = newBHT(entry.branchPred, taken);
-                    return;
-                }
-            } else {
-                victimIdx = i;
-            }
-        }
-        if (victimIdx == (size_t)-1) {
-            victimIdx = randBy(std::uniform_int_distribution<size_t>(0, btb.size() - 1));
+        auto set = btbSet(branchPc);
+        auto way = btbFind(set, branchPc);
+        if (way != INVALID && btb[set * btbWays + way].targetPc == targetPc) {
+            auto& entry = btb[set * btbWays + way];
+            entry.branchPred = newBHT(entry.branchPred, taken);
+            btbTouch(set, way);
+            return;
         }
 
-        auto& victim = btb[victimIdx];
-        victim = {
+        // 未命中, 或者部分标签混淆了目标不同的分支时, 重新分配一项
+        if (way == INVALID)
+            way = btbVictim(set);
+        btb[set * btbWays + way] = {
             .valid = true,
             .branchPred = taken ? BHT::STRONGTAKEN : BHT::STRONGNOT,
             .branchPc = branchPc,
             .targetPc = targetPc,
         };
+        btbTouch(set, way);
     }
 
     word getTarget(word branchPc) const {
@@ -293,22 +553,26 @@ struct MachineState {
          * 如果不是, 返回当前 pc+1, 这意味着我们预测分支跳转不会成功;
          * 如果在, 并且历史信息为 STRONGTAKEN 或 WEAKTAKEN, 返回跳转的目标地址,
          * 如果历史信息为 STRONGNOT 或 WEAKNOT, 返回当前 pc+1.
+         * 使用其他预测器时, 缓冲栈只提供目标地址, 方向由 `predictor` 决定.
+         * 替换状态只在提交时由 `updateBTB` 更新, 错误路径上的查找不会影响它.
          */
-        for (const auto& pred : btb) {
-            if (pred.valid && pred.branchPc == branchPc) {
-                switch (pred.branchPred) {
-                case BHT::STRONGNOT:
-                case BHT::WEAKNOT:
-                    return branchPc + 1;
-                case BHT::WEAKTAKEN:
-                case BHT::STRONGTAKEN:
-                    return pred.targetPc;
-                default:
-                    __builtin_unreachable();
-                }
-            }
+        auto set = btbSet(branchPc);
+        auto way = btbFind(set, branchPc);
+        if (way == INVALID)
+            return branchPc + 1;
+        const auto& pred = btb[set * btbWays + way];
+        if (config.predictor != BIMODAL)
+            return predictor.predict(branchPc) ? pred.targetPc : branchPc + 1;
+        switch (pred.branchPred) {
+        case BHT::STRONGNOT:
+        case BHT::WEAKNOT:
+            return branchPc + 1;
+        case BHT::WEAKTAKEN:
+        case BHT::STRONGTAKEN:
+            return pred.targetPc;
+        default:
+            __builtin_unreachable();
         }
-        return branchPc + 1;
     }
 
     size_t robHead() const {
@@ -322,254 +586,736 @@ struct MachineState {
             return (size_t)-1;
         auto ret = robHeadIdx;
         rob[ret] = {};
-        robHeadIdx += 1;
-        robHeadIdx %= ROBSIZE;
+        clearLsq(ret);
+        robHeadIdx = robNext(robHeadIdx);
         return ret;
     }
 
     size_t robPush() {
         //* 相当于在循环队列中 `pushBack`
-        if ((robHeadIdx - robTailIdx) % ROBSIZE == 1)
+        if (robNext(robTailIdx) == robHeadIdx)
             return (size_t)-1;
         auto ret = robTailIdx;
-        robTailIdx += 1;
-        robTailIdx %= ROBSIZE;
+        robTailIdx = robNext(robTailIdx);
         return ret;
     }
 
     void loadInstr(word pc, const char* instr) {
         //* 加载一条指令至给定位置, 用来和可视化代码交互
-        memcpy(&memory[pc], instr, sizeof(word));
+        if (pc >= memory.size())
+            throw TomasuloError("Address", pc, "is out of memory");
+        word value;
+        memcpy(&value, instr, sizeof(word));
+        memory.write(pc, value);
+        invalidateUops(pc, 1);
+    }
+
+    void writeMemory(word address, const word* values, word count) {
+        //* 从外部改写一段内存, 调用者保证不越界
+        memory.writeRange(address, values, count);
+        invalidateUops(address, count);
+    }
+
+    const MicroOp& fetchUop(word pc) {
+        //* 取出 pc 处预译码的指令, 第一次取到或代码被改写之后才译码; 调用者保证 pc 不越界
+        return fetchUop(pc, memory);
+    }
+
+    const MicroOp& fetchUop(word pc, const PagedMemory& code) {
+        //* 同上, 但从 `code` 中译码, 供代码与数据分开存放的 `MachineBatch` 使用
+        if (__builtin_expect(pc >= uops.size(), 0))
+            uops.resize(std::max(memorySize, pc + 1), UNDECODED_UOP);
+        auto& uop = uops[pc];
+        if (__builtin_expect(uop.op == UNDECODED_OP, 0))
+            uop = predecode(code[pc]);
+        return uop;
+    }
+
+    void invalidateUops(word address, word count) {
+        //* 丢弃 [address, address + count) 的预译码结果, 在改写内存之后调用
+        auto end = std::min<uint64_t>(uint64_t(address) + count, uops.size());
+        for (uint64_t a = address; a < end; ++a)
+            uops[a].op = UNDECODED_OP;
+    }
+
+    word loadImage(const word* words, size_t count) {
+        //* 把整个程序写入从 pc 开始的内存, 并把内存的可用区间设为程序末尾, 返回指令数; 同时检查每条指令并填好预译码缓存
+        if (pc + uint64_t(count) > memory.size())
+            throw TomasuloError("Program of", count, "words does not fit in memory");
+        std::vector<MicroOp> decoded(count);
+        for (size_t i = 0; i < count; i++) {
+            decoded[i] = predecode(words[i]);
+            if (decoded[i].op == ILLEGAL_OP)
+                throw TomasuloError("Invalid instruction", words[i], "at address", pc + i);
+        }
+        memory.writeRange(pc, words, (word)count);
+        setMemorySize(pc + (word)count);
+        if (uops.size() < memorySize)
+            uops.resize(memorySize, UNDECODED_UOP);
+        std::copy(decoded.begin(), decoded.end(), uops.begin() + pc);
+        return (word)count;
+    }
+
+    word loadBinary(std::string_view bytes) {
+        //* 加载 `scripts/assembler.py` 生成的二进制程序, 即本机字节序的连续指令
+        if (bytes.size() % sizeof(word) != 0)
+            throw TomasuloError("Program size", bytes.size(), "is not a multiple of", sizeof(word));
+        std::vector<word> words(bytes.size() / sizeof(word));
+        if (!words.empty())
+            memcpy(words.data(), bytes.data(), bytes.size());
+        return loadImage(words.data(), words.size());
+    }
+
+    word loadProgram(std::string_view text, const std::string& source = "<string>") {
+        //* 汇编并加载程序, 语法见 `Assembler`
+        auto words = Assembler::assemble(text, source);
+        return loadImage(words.data(), words.size());
     }
 
     void setMemorySize(word size) {
         //* 设置内存的可用区间大小, 用来和可视化代码交互
+        if (size > memory.size())
+            throw TomasuloError("Memory size", size, "exceeds", memory.size());
         memorySize = size;
     }
 
     void commitInstr(word robIdx) {
-        //* 提交一条指令, 视指令类型造成相应的后果
+        //* 提交一条指令, 视指令类型造成相应的后果, 见 `commitOp`
+        opHandlers(rob[robIdx].uop.op).commit(*this, robIdx);
+    }
+
+    void commitBranch(word robIdx) {
+        //* 提交分支: 更新预测器, 预测错误时按恢复方式清空流水线
+        commitBranch(robIdx, rob[robIdx].result == 0);
+    }
+
+    void commitBranch(word robIdx, bool taken) {
+        //* 同上, 但分支方向由调用者给出
         auto& robEntry = rob[robIdx];
-        auto op = opcode(robEntry.instr);
-        auto result = robEntry.result;
-        auto instr = robEntry.instr;
-        switch (op) {
-        case LW:
-        case ADDI:
-        case ANDI: {
-            auto rd = reg2(instr);
-            if (regResult[rd].robIdx == robIdx) {
-                regResult[rd] = {};
-            }
-            regFile[rd] = result;
+        auto branchTarget = robEntry.uop.imm + 1 + robEntry.pc;
+        updateBTB(robEntry.pc, branchTarget, taken);
+        traceEvent(EV_BTB, robIdx, taken, robEntry.pc, branchTarget);
+        predictor.update(robEntry.pc, taken);
+        retire(robIdx);
+        stats.branches += 1;
+        auto nextPc = taken ? branchTarget : robEntry.pc + 1;
+        if (robEntry.address != nextPc)
+            stats.mispredicts += 1;
+        // 写回时恢复的分支已经重定向过了, 这里只需提交
+        if (robEntry.address != nextPc && config.branchRecovery == COMMIT) {
+            flushPipeline(nextPc);
+        } else {
             robPop();
-            return;
         }
-        case RR_ALU: {
-            auto rd = reg3(instr);
-            if (regResult[rd].robIdx == robIdx) {
-                regResult[rd] = {};
+    }
+
+    void commitStore(word robIdx) {
+        //* 提交 store: 先转入 store 保留栈, 等待写内存的延迟之后才真正提交
+        auto& robEntry = rob[robIdx];
+        auto result = robEntry.result;
+        auto unit = robEntry.execUnit;
+        if (!config.isStore(unit)) {
+            for (auto reservIdx = config.firstStore(); reservIdx < config.firstInt(); ++reservIdx) {
+                auto& reserv = reservation[reservIdx];
+                if (!reserv.busy) {
+                    reserv = {
+                        .busy = true,
+                        .instr = robEntry.instr,
+                        .uop = robEntry.uop,
+                        .Vj = result,
+                        .Vk = robEntry.address,
+                        .Qj = READY,
+                        .Qk = READY,
+                        .exTimeLeft = storeLatency(robEntry.address) - 1,
+                        .robIdx = robIdx,
+                    };
+                    robEntry.execUnit = reservIdx;
+                    return;
+                }
             }
-            regFile[rd] = result;
+        } else if (reservation[unit].exTimeLeft == 0) {
+            auto value = reservation[unit].Vj;
+            auto address = reservation[unit].Vk;
+            if (address >= memory.size())
+                throw TomasuloError("Store to invalid address", address, "at pc=", robEntry.pc);
+            memory.write(address, value);
+            invalidateUops(address, 1);
+            traceEvent(EV_MEMWRITE, robIdx, unit, address, value);
+            reservation[unit] = {};
+            retire(robIdx);
             robPop();
-            return;
+        } else {
+            reservation[unit].exTimeLeft -= 1;
         }
-        case BEQZ: {
-            auto branchTarget = immEx(instr) + 1 + robEntry.pc;
-            auto taken = result == 0;
-            updateBTB(robEntry.pc, branchTarget, taken);
-            if ((taken && robEntry.address != branchTarget) || (!taken && robEntry.address != robEntry.pc + 1)) {
-                resetROB();
-                resetReserve();
-                resetRegResult();
-                pc = branchTarget;
-            } else {
-                robPop();
-            }
-            return;
+    }
+
+    void retire(word robIdx) {
+        //* 统计并跟踪一条指令的提交, 须在 `robPop` 清空该项之前调用
+        const auto& robEntry = rob[robIdx];
+        traceEvent(EV_COMMIT, robIdx, robEntry.execUnit, robEntry.pc, robEntry.result);
+        stats.committed += 1;
+    }
+
+    word loadLatency(word address) {
+        //* 打开缓存时 load 的延迟, 越界的 load 不访问缓存
+        return address < memory.size() ? cache.access(address, false, stats) : cache.hitLatency;
+    }
+
+    word storeLatency(word address) {
+        //* store 在提交时写内存所需的周期数
+        if (!cache.enabled() || address >= memory.size())
+            return config.storeExec;
+        return cache.access(address, true, stats);
+    }
+
+    word loadValue(word robIdx, word address) {
+        /*
+         * 读取 load 的值, ROB 中的 load 与 store 即为 load/store 队列:
+         * 从更早的 store 中找出最近一个地址相同且已写回的, 转发它的数据, 否则读内存.
+         * 尚未写回的 store 地址未知, 推测它们与 load 不冲突, 出错时由 `checkOrder` 标记重新执行.
+         * 错误预测路径上的 load 可能算出任意地址, 越界时读到 0.
+         */
+        auto idx = forwardingStore(robIdx, address);
+        if (idx != INVALID)
+            return rob[idx].result;
+        return address < memory.size() ? memory[address] : 0;
+    }
+
+    word forwardingStore(word robIdx, word address) {
+        //* 记录 load 的地址, 返回向它转发数据的 store, 没有时返回 INVALID
+        rob[robIdx].address = address;
+        auto idx = INVALID;
+        if (robIdx >= robHeadIdx) {
+            idx = lastMatch(robStores, robHeadIdx, robIdx, address);
+        } else {
+            // 循环队列绕回, 先查 [0, robIdx), 再查 [robHeadIdx, robSize)
+            idx = lastMatch(robStores, 0, robIdx, address);
+            if (idx == INVALID)
+                idx = lastMatch(robStores, robHeadIdx, config.robSize, address);
         }
-        case SW: {
-            auto unit = robEntry.execUnit;
-            if (unit != STORE1 && unit != STORE2) {
-                for (auto reservIdx : {STORE1, STORE2}) {
-                    auto& reserv = reservation[reservIdx];
-                    if (!reserv.busy) {
-                        reserv = {
-                            .busy = true,
-                            .instr = instr,
-                            .Vj = result,
-                            .Vk = robEntry.address,
-                            .Qj = READY,
-                            .Qk = READY,
-                            .exTimeLeft = STEXEC - 1,
-                            .robIdx = robIdx,
-                        };
-                        robEntry.execUnit = reservIdx;
-                        return;
-                    }
-                }
-            } else if (reservation[unit].exTimeLeft == 0) {
-                auto value = reservation[unit].Vj;
-                auto address = reservation[unit].Vk;
-                memory[address] = value;
+        return idx;
+    }
+
+    uint64_t lsqMatch(const std::vector<uint64_t>& kind, word block, word begin, word end, word address) const {
+        /*
+         * 第 `block` 块中下标位于 [begin, end) 且属于 `kind`, 地址为 `address` 的项的位图.
+         * 块中没有候选项时不做比较, 这是最常见的情况.
+         */
+        auto base = block * 64;
+        auto lo = std::max(begin, base) - base;
+        auto hi = std::min(end, base + 64) - base;
+        auto bits = kind[block] & (hi == 64 ? ~uint64_t(0) : bit(hi) - 1) & ~(bit(lo) - 1);
+        if (bits == 0)
+            return 0;
+        return bits & matchWords(robAddress.data() + base, hi, address);
+    }
+
+    word lastMatch(const std::vector<uint64_t>& kind, word begin, word end, word address) const {
+        //* [begin, end) 中属于 `kind` 且地址为 `address` 的最后一项, 没有时返回 INVALID
+        if (begin >= end)
+            return INVALID;
+        for (auto block = (end - 1) / 64 + 1; block-- > begin / 64;) {
+            if (auto bits = lsqMatch(kind, block, begin, end, address))
+                return block * 64 + 63 - __builtin_clzll(bits);
+        }
+        return INVALID;
+    }
+
+    bool markReplays(word begin, word end, word address) {
+        /*
+         * 按先后顺序标记 [begin, end) 中地址为 `address` 的 load 需要重新执行,
+         * 遇到地址相同的 store 时停止并返回 true.
+         */
+        if (begin >= end)
+            return false;
+        for (auto block = begin / 64; block <= (end - 1) / 64; ++block) {
+            auto loads = lsqMatch(robLoads, block, begin, end, address);
+            auto stores = lsqMatch(robStores, block, begin, end, address);
+            if (stores != 0)
+                loads &= (stores & -stores) - 1;
+            for (; loads; loads &= loads - 1)
+                rob[block * 64 + __builtin_ctzll(loads)].replay = true;
+            if (stores != 0)
+                return true;
+        }
+        return false;
+    }
+
+    void checkOrder(word storeIdx) {
+        //* store 写回后, 标记越过它读到旧值的更年轻的 load; 遇到地址相同的更年轻的 store 即可停止
+        auto address = rob[storeIdx].address;
+        if (storeIdx < robTailIdx) {
+            markReplays(storeIdx + 1, robTailIdx, address);
+        } else if (!markReplays(storeIdx + 1, config.robSize, address)) {
+            markReplays(0, robTailIdx, address);
+        }
+    }
+
+    void flushPipeline(word nextPc) {
+        //* 清空流水线, 从 `nextPc` 重新取指; 由队头的分支或 load 引起
+        traceEvent(EV_SQUASH, robHeadIdx, rob[robHeadIdx].execUnit, nextPc, robAge(robTailIdx) - 1);
+        if constexpr (COUNTERS)
+            stats.flushes += 1;
+        resetROB();
+        resetReserve();
+        resetRegResult();
+        predictor.recover();
+        pc = nextPc;
+        fetchStall = config.recoveryLatency;
+    }
+
+    void squashAfter(word robIdx) {
+        //* 清除 ROB 中比 `robIdx` 年轻的所有指令, 以及它们占用的保留栈
+        auto age = robAge(robIdx);
+        uint64_t squashed = 0;
+        for (auto idx = robNext(robIdx); idx != robTailIdx; idx = robNext(idx)) {
+            auto unit = rob[idx].execUnit;
+            if (unit < reservation.size() && reservation[unit].busy && reservation[unit].robIdx == idx) {
                 reservation[unit] = {};
-                robPop();
-            } else {
-                reservation[unit].exTimeLeft -= 1;
+                waiters[unit] = 0;
+                squashed |= bit(unit);
             }
-            break;
+            rob[idx] = {};
+            clearLsq(idx);
         }
-        default:
-            robPop();
+        activeMask &= ~squashed;
+        for (auto& mask : waiters) {
+            mask &= ~squashed;
+        }
+        written.erase(std::remove_if(written.begin(), written.end(), [&](word idx) { return robAge(idx) > age; }),
+                      written.end());
+        robTailIdx = robNext(robIdx);
+    }
+
+    void resolveBranch(word robIdx) {
+        /*
+         * 分支写回时检查预测是否正确:
+         * 预测错误时只清除比分支年轻的指令, 从分支检查点恢复寄存器状态和推测历史, 并重定向 pc.
+         * 检查点中指向已提交指令的项, 其结果已经写入寄存器, 恢复为有效.
+         * 分支本身留在 ROB 中, 提交时只更新预测器和统计信息.
+         */
+        resolveBranch(robIdx, rob[robIdx].result == 0);
+    }
+
+    void resolveBranch(word robIdx, bool taken) {
+        //* 同上, 但分支方向由调用者给出
+        const auto& robEntry = rob[robIdx];
+        auto nextPc = taken ? robEntry.uop.imm + 1 + robEntry.pc : robEntry.pc + 1;
+        if (robEntry.address == nextPc)
             return;
+        traceEvent(EV_SQUASH, robIdx, robEntry.execUnit, nextPc, robAge(robTailIdx) - robAge(robIdx) - 1);
+        if constexpr (COUNTERS)
+            stats.flushes += 1;
+        squashAfter(robIdx);
+        const auto& ckpt = branchCheckpoints[robIdx];
+        auto age = robAge(robIdx);
+        for (word reg = 0; reg < NUMREGS; ++reg) {
+            auto entry = ckpt.regResult[reg];
+            if (!entry.valid && robAge(entry.robIdx) >= age)
+                entry = {};
+            regResult[reg] = entry;
         }
+        predictor.recover(ckpt.specHistory << 1 | uint64_t(taken));
+        pc = nextPc;
+        fetchStall = config.recoveryLatency;
     }
 
     word getResult(word reservIdx) {
-        //* 模拟执行完毕了得到结果
-        const auto& reserv = reservation[reservIdx];
-        auto instr = reserv.instr;
-        auto op = opcode(instr);
-        auto imm16 = immEx(instr);
-        auto imm26 = jmpOffsetEx(instr);
-        auto funccode = func(instr);
-
-        switch (op) {
-        case ANDI:
-            return reserv.Vj & imm16;
-        case ADDI:
-            return reserv.Vj + imm16;
-        case RR_ALU:
-            switch (funccode) {
-            case FUNC_ADD:
-                return reserv.Vj + reserv.Vk;
-            case FUNC_SUB:
-                return reserv.Vj - reserv.Vk;
-            case FUNC_AND:
-                return reserv.Vj & reserv.Vk;
-            default:
-                __builtin_unreachable();
+        //* 模拟执行完毕了得到结果, 见 `resultOp`
+        return opHandlers(reservation[reservIdx].uop.op).result(*this, reservIdx);
+    }
+
+    bool issueNext() {
+        //* 按顺序发射下一条指令, 没有空闲的保留栈或 ROB 已满时返回 false
+        if (pc >= memorySize)
+            return false;
+        const auto& traits = OPTRAITS[fetchUop(pc).op];
+        if (!traits.valid)
+            throw TomasuloError("Invalid instruction", memory[pc], "at pc=", pc);
+        auto load = traits.unit == UNIT_LOAD;
+        auto first = load ? config.firstLoad() : config.firstInt();
+        auto last = load ? config.firstStore() : config.numUnits() + 1;
+        word unit = INVALID;
+        for (auto idx = first; idx < last; ++idx) {
+            if (!reservation[idx].busy) {
+                unit = idx;
+                break;
             }
-        case LW:
-            return memory[reserv.Vj + imm16];
-        case SW:
-            return reserv.Vk;
-        case BEQZ:
-            return reserv.Vj;
-        case J:
-            return imm26;
-        default:
-            return 0;
         }
+
+        if (unit == INVALID) {
+            stats.stalls += 1;
+            if constexpr (COUNTERS)
+                stats.stallsNoStation += 1;
+            return false;
+        }
+        auto robIdx = robPush();
+        if (robIdx == (size_t)-1) {
+            stats.stalls += 1;
+            if constexpr (COUNTERS)
+                stats.stallsRobFull += 1;
+            return false;
+        }
+        issueInstr(pc, unit, robIdx);
+        traceEvent(EV_ISSUE, robIdx, unit, pc, rob[robIdx].instr);
+        if (traits.control == CTRL_BRANCH) {
+            if (config.branchRecovery == WRITEBACK)
+                branchCheckpoints[robIdx] = {regResult, predictor.specHistory};
+            auto target = getTarget(pc);
+            predictor.speculate(target != pc + 1);
+            pc = target;
+            rob[robIdx].address = pc;
+        } else if (traits.control == CTRL_JUMP) {
+            pc += rob[robIdx].uop.imm + 1;
+        } else if (pc < memorySize - 1) {
+            pc += 1;
+        }
+        return true;
     }
 
     bool nextStep() {
         //* 模拟时钟前进
         cycles += 1;
         // committing
-        if (auto head = robHead(); head != (size_t)-1) {
+        // 每周期按顺序最多提交 commitWidth 条指令, 遇到未完成的 store 或者清空流水线时停止
+        for (word i = 0; i < config.commitWidth; ++i) {
+            auto head = robHead();
+            if (head == (size_t)-1)
+                break;
             const auto& robEntry = rob[head];
-            if (robEntry.busy && robEntry.valid && robEntry.instrStatus == COMMITTING) {
-                if (opcode(robEntry.instr) != HALT)
-                    commitInstr(head);
-                else {
-                    robPop();
-                    return true;
-                }
+            if (!robEntry.busy || !robEntry.valid || robEntry.instrStatus != COMMITTING)
+                break;
+            if (robEntry.uop.op == HALT) {
+                retire(head);
+                robPop();
+                return true;
             }
+            commitInstr(head);
+            if (robHeadIdx == head)
+                break;
         }
 
         // processing
-        bool cdbFree = true;
-        for (size_t robIdx = robHeadIdx; robIdx != robTailIdx; robIdx = (robIdx + 1) % ROBSIZE) {
-            auto& robEntry = rob[robIdx];
-            auto unit = robEntry.execUnit;
+        // 上一周期写回结果的指令进入提交状态
+        for (auto robIdx : written) {
+            rob[robIdx].instrStatus = COMMITTING;
+        }
+        written.clear();
+
+        // 只访问尚未写回的保留栈, 并按照指令的先后顺序排列, 越早的指令越先占用公共数据总线
+        std::array<word, 64> order;
+        word count = 0;
+        for (auto mask = activeMask; mask; mask &= mask - 1) {
+            word unit = __builtin_ctzll(mask);
+            auto age = robAge(reservation[unit].robIdx);
+            auto pos = count++;
+            for (; pos > 0 && robAge(reservation[order[pos - 1]].robIdx) > age; --pos) {
+                order[pos] = order[pos - 1];
+            }
+            order[pos] = unit;
+        }
+
+        // 共有 numCDB 条公共数据总线, 按指令先后顺序分配
+        word cdbLeft = config.numCDB;
+        auto writeResult = [&](word unit) {
+            auto robIdx = reservation[unit].robIdx;
+            auto value = getResult(unit);
+            traceEvent(EV_BROADCAST, robIdx, unit, rob[robIdx].pc, value);
+            broadcastUpdate(unit, value);
+            reservation[unit] = {};
+            activeMask &= ~bit(unit);
+            written.push_back(robIdx);
+            cdbLeft -= 1;
+            auto op = rob[robIdx].uop.op;
+            if ((op == SW || op == LW) && rob[robIdx].valid) {
+                robAddress[robIdx] = rob[robIdx].address;
+                (op == SW ? robStores : robLoads)[robIdx / 64] |= bit(robIdx % 64);
+            }
+            if (op == SW)
+                checkOrder(robIdx);
+            else if (op == BEQZ && config.branchRecovery == WRITEBACK)
+                resolveBranch(robIdx);
+        };
+        for (word i = 0; i < count; ++i) {
+            auto unit = order[i];
+            if (!(activeMask & bit(unit)))
+                continue; // 已被本周期较早写回的分支清除
             auto& reserv = reservation[unit];
-            auto instr = robEntry.instr;
-
-            if (robEntry.busy) {
-                if (robEntry.instrStatus == EXECUTING) {
-                    if (reserv.exTimeLeft != 0)
-                        reserv.exTimeLeft -= 1;
-                    else {
-                        robEntry.instrStatus = WRITING_RESULT;
-                        if (opcode(instr) == SW) {
-                            robEntry.address = reserv.Vj + immEx(instr);
-                        }
-                        if (cdbFree) {
-                            broadcastUpdate(unit, getResult(unit));
-                            reserv = {};
-                            cdbFree = false;
-                        }
+            auto& robEntry = rob[reserv.robIdx];
+            auto op = reserv.uop.op;
+
+            if (robEntry.instrStatus == EXECUTING) {
+                if (reserv.exTimeLeft != 0)
+                    reserv.exTimeLeft -= 1;
+                else {
+                    robEntry.instrStatus = WRITING_RESULT;
+                    if (op == SW) {
+                        robEntry.address = reserv.Vj + reserv.uop.imm;
                     }
-                } else if (robEntry.instrStatus == WRITING_RESULT) {
-                    if (robEntry.valid) {
-                        robEntry.instrStatus = COMMITTING;
-                    } else if (cdbFree) {
-                        broadcastUpdate(unit, getResult(unit));
-                        reserv = {};
-                        cdbFree = false;
+                    if (cdbLeft != 0) {
+                        writeResult(unit);
+                    } else if constexpr (COUNTERS) {
+                        stats.cdbConflicts += 1;
                     }
-                } else if (robEntry.instrStatus == ISSUING && reserv.Qj == READY && reserv.Qk == READY) {
-                    robEntry.instrStatus = EXECUTING;
-                    reserv.exTimeLeft -= 1;
                 }
+            } else if (robEntry.instrStatus == WRITING_RESULT) {
+                if (cdbLeft != 0) {
+                    writeResult(unit);
+                } else if constexpr (COUNTERS) {
+                    stats.cdbConflicts += 1;
+                }
+            } else if (robEntry.instrStatus == ISSUING && reserv.Qj == READY && reserv.Qk == READY) {
+                robEntry.instrStatus = EXECUTING;
+                // 地址在操作数就绪时才确定, 此时再访问缓存得到 load 的延迟
+                if (cache.enabled() && op == LW)
+                    reserv.exTimeLeft = loadLatency(reserv.Vj + reserv.uop.imm);
+                traceEvent(EV_EXECUTE, reserv.robIdx, unit, robEntry.pc, reserv.exTimeLeft);
+                reserv.exTimeLeft -= 1;
             }
         }
 
         // issuing
-        if (pc >= memorySize)
-            return false;
-        auto instr = memory[pc];
-        auto op = opcode(instr);
-        word unit = INVALID;
-        switch (op) {
-        case RR_ALU:
-        case SW:
-        case ADDI:
-        case ANDI:
-        case J:
-        case HALT:
-        case NOOP:
-        case BEQZ:
-            for (auto idx : {INT1, INT2}) {
-                if (!reservation[idx].busy) {
-                    unit = idx;
-                    break;
-                }
+        if (fetchStall != 0) {
+            fetchStall -= 1;
+        } else {
+            for (word i = 0; i < config.issueWidth && issueNext(); ++i) {
+            }
+        }
+
+        // 每周期结束时采样占用情况; 忙碌的保留栈即尚未写回的, 以及提交时占用的 store 保留栈
+        if constexpr (COUNTERS) {
+            robOccupancy[robAge(robTailIdx)] += 1;
+            for (auto mask = activeMask; mask; mask &= mask - 1)
+                unitBusy[__builtin_ctzll(mask)] += 1;
+            for (auto unit = config.firstStore(); unit < config.firstInt(); ++unit)
+                unitBusy[unit] += reservation[unit].busy;
+        }
+        return false;
+    }
+
+    RunSummary run(uint64_t maxCycles, const StopCondition& cond = {}) {
+        //* 连续运行直到 halt, 断点, 监视点或周期上限, 避免逐周期地与 Python 交互
+        if (cond.watchAddr != INVALID && cond.watchAddr >= memory.size())
+            throw TomasuloError("Invalid watch address:", cond.watchAddr);
+        RunSummary summary{};
+        auto startCommitted = stats.committed;
+        auto watched = cond.watchAddr != INVALID ? memory[cond.watchAddr] : 0;
+        while (true) {
+            if (summary.cycles >= maxCycles) {
+                summary.reason = CYCLE_LIMIT;
+                break;
             }
-            break;
-        case LW:
-            for (auto idx : {LOAD1, LOAD2}) {
-                if (!reservation[idx].busy) {
-                    unit = idx;
+            auto lastPc = pc;
+            summary.cycles += 1;
+            if (nextStep()) {
+                summary.halted = true;
+                summary.reason = HALTED;
+                break;
+            }
+            if (cond.breakPc != INVALID && pc == cond.breakPc && lastPc != pc) {
+                summary.reason = BREAKPOINT;
+                break;
+            }
+            if (cond.watchAddr != INVALID && memory[cond.watchAddr] != watched) {
+                summary.reason = WATCHPOINT;
+                break;
+            }
+        }
+        summary.committed = stats.committed - startCommitted;
+        return summary;
+    }
+
+    RunSummary runUntilHalt(uint64_t maxCycles = UINT64_MAX) {
+        //* 运行直到 halt
+        return run(maxCycles);
+    }
+
+    void drainPipeline() {
+        //* 丢弃 ROB 与保留栈中所有尚未提交的指令, 从最早的一条重新取指, 不计入统计
+        if (robHeadIdx != robTailIdx)
+            pc = rob[robHeadIdx].pc;
+        resetROB();
+        resetReserve();
+        resetRegResult();
+        predictor.recover();
+        fetchStall = 0;
+    }
+
+    RunSummary fastForward(uint64_t maxInstrs, const StopCondition& cond = {}, bool warm = true) {
+        return fastForwardBlocks(maxInstrs, cond, warm, [](word, uint64_t) {});
+    }
+
+    template <class OnBlock>
+    RunSummary fastForwardBlocks(uint64_t maxInstrs, const StopCondition& cond, bool warm, OnBlock&& onBlock) {
+        /*
+         * 不经过流水线, 直接在寄存器和内存上按指令语义执行, 用于快速跳到程序中感兴趣的位置.
+         * 流水线中尚未提交的指令先被丢弃, 从最早的一条开始执行; 周期数不变.
+         * 在 halt 之前, 执行了 `maxInstrs` 条之后, 将要执行断点处的指令或监视的内存字改变时停止,
+         * 此后可以直接用 `run` 继续.
+         * `warm` 为真时像提交时一样训练分支预测缓冲栈, 方向预测器和数据缓存, 但不改变统计信息.
+         * 每执行一条分支或跳转, 即一个基本块的末尾, 以 (它的 pc, 本次已执行的指令数) 调用 `onBlock`.
+         */
+        if (cond.watchAddr != INVALID && cond.watchAddr >= memory.size())
+            throw TomasuloError("Invalid watch address:", cond.watchAddr);
+        drainPipeline();
+        RunSummary summary{};
+        Stats scratch{}; // 预热缓存时的命中与缺失不计入统计
+        auto watching = cond.watchAddr != INVALID;
+        auto watched = watching ? memory[cond.watchAddr] : 0;
+        if (uops.size() < memorySize)
+            uops.resize(memorySize, UNDECODED_UOP); // 此后循环中不再改变大小
+        // 寄存器与 pc 放在局部变量中, 避免每次写内存之后重新读取; 返回或抛出异常之前写回
+        auto regs = regFile;
+        auto cur = pc;
+        uint64_t count = 0;
+        auto fail = [&](auto&&... args) {
+            regFile = regs;
+            pc = cur;
+            stats.fastForwarded += count;
+            throw TomasuloError(args...);
+        };
+        while (true) {
+            if (count >= maxInstrs) {
+                summary.reason = INSTR_LIMIT;
+                break;
+            }
+            if (cur == cond.breakPc && count > 0) {
+                summary.reason = BREAKPOINT;
+                break;
+            }
+            if (cur >= memorySize) {
+                // 与 `issueNext` 一样, 越过程序末尾后不再取指
+                summary.reason = INSTR_LIMIT;
+                break;
+            }
+            auto& slot = uops[cur];
+            if (__builtin_expect(slot.op == UNDECODED_OP, 0))
+                slot = predecode(memory[cur]);
+            auto uop = slot; // 复制一份, store 可能改写这条指令本身
+            if (uop.op == HALT) {
+                // halt 留给流水线提交, 之后用 `run` 结束程序
+                summary.halted = true;
+                summary.reason = HALTED;
+                break;
+            }
+            auto next = cur < memorySize - 1 ? cur + 1 : cur;
+            switch (uop.op) {
+            case ADDI:
+                regs[uop.rd] = regs[uop.rs1] + uop.imm;
+                break;
+            case ANDI:
+                regs[uop.rd] = regs[uop.rs1] & uop.imm;
+                break;
+            case RR_ALU: {
+                auto a = regs[uop.rs1];
+                auto b = regs[uop.rs2];
+                regs[uop.rd] = aluFunc(uop.imm, a, b);
+                break;
+            }
+            case LW: {
+                auto address = regs[uop.rs1] + uop.imm;
+                if (address >= memory.size()) {
+                    regs[uop.rd] = 0;
                     break;
                 }
+                if (warm && cache.enabled())
+                    cache.access(address, false, scratch);
+                regs[uop.rd] = memory[address];
+                break;
             }
-            break;
-        default:
-            throw TomasuloError("Invalid op:", op, "pc:", pc);
-        }
-
-        if (unit != INVALID) {
-            auto robIdx = robPush();
-            if (robIdx != (size_t)-1) {
-                issueInstr(pc, unit, robIdx);
-                if (op == BEQZ) {
-                    pc = getTarget(pc);
-                    rob[robIdx].address = pc;
-                } else if (op == J) {
-                    pc += jmpOffsetEx(instr) + 1;
-                } else if (pc < memorySize - 1) {
-                    pc += 1;
+            case SW: {
+                auto address = regs[uop.rs1] + uop.imm;
+                if (address >= memory.size())
+                    fail("Store to invalid address", address, "at pc=", cur);
+                if (warm && cache.enabled())
+                    cache.access(address, true, scratch);
+                memory.write(address, regs[uop.rs2]);
+                invalidateUops(address, 1);
+                break;
+            }
+            case BEQZ: {
+                auto target = uop.imm + 1 + cur;
+                auto taken = regs[uop.rs1] == 0;
+                if (warm) {
+                    updateBTB(cur, target, taken);
+                    predictor.update(cur, taken);
                 }
+                next = taken ? target : cur + 1;
+                onBlock(cur, count + 1);
+                break;
+            }
+            case J:
+                next = cur + uop.imm + 1;
+                onBlock(cur, count + 1);
+                break;
+            case NOOP:
+                break;
+            default:
+                fail("Invalid instruction", memory[cur], "at pc=", cur);
+            }
+            cur = next;
+            count += 1;
+            if (uop.op == SW && watching && memory[cond.watchAddr] != watched) {
+                summary.reason = WATCHPOINT;
+                break;
             }
         }
-
-        return false;
+        regFile = regs;
+        pc = cur;
+        predictor.recover();
+        summary.committed = count;
+        stats.fastForwarded += count;
+        return summary;
     }
 };
 
+template <class F> void visitCounters(const MachineState& state, F&& f) {
+    //* 依次以 (名称, 数值) 访问标量计数器及导出的比率, 供命令行与 Python 的 `stats()` 使用
+    const auto& stats = state.stats;
+    uint64_t occupied = 0;
+    for (size_t n = 0; n < state.robOccupancy.size(); n++)
+        occupied += n * state.robOccupancy[n];
+    f("cycles", uint64_t(state.cycles));
+    f("committed", stats.committed);
+    f("ipc", state.cycles ? double(stats.committed) / state.cycles : 0.0);
+    f("stalls", stats.stalls);
+    f("stallsNoStation", stats.stallsNoStation);
+    f("stallsRobFull", stats.stallsRobFull);
+    f("cdbConflicts", stats.cdbConflicts);
+    f("branches", stats.branches);
+    f("mispredicts", stats.mispredicts);
+    f("accuracy", stats.accuracy());
+    f("flushes", stats.flushes);
+    f("replays", stats.replays);
+    f("fastForwarded", stats.fastForwarded);
+    f("cacheHits", stats.cacheHits);
+    f("cacheMisses", stats.cacheMisses);
+    f("cacheWritebacks", stats.cacheWritebacks);
+    f("hitRate", stats.hitRate());
+    f("robOccupancyMean", state.cycles ? double(occupied) / state.cycles : 0.0);
+}
+
+inline void printCounters(const MachineState* state) {
+    printf("\tCounters:\n");
+    visitCounters(*state, [](const char* name, auto value) {
+        if constexpr (std::is_floating_point_v<decltype(value)>)
+            printf("\t\t%s = %.4f\n", name, value);
+        else
+            printf("\t\t%s = %llu\n", name, (unsigned long long)value);
+    });
+    printf("\tUnit occupancy:\n");
+    for (word unit = 1; unit <= state->config.numUnits(); unit++) {
+        auto busy = state->unitBusy[unit];
+        printf("\t\t%s: %llu cycles (%.2f%%)\n", state->config.unitName(unit).c_str(), (unsigned long long)busy,
+               state->cycles ? 100.0 * busy / state->cycles : 0.0);
+    }
+    printf("\tROB occupancy:\n");
+    for (word n = 0; n < state->robOccupancy.size(); n++) {
+        if (state->robOccupancy[n] != 0)
+            printf("\t\t%u entries: %llu cycles\n", n, (unsigned long long)state->robOccupancy[n]);
+    }
+}
+
 inline void printState(const MachineState* state, word memorySize) {
     word i;
 
@@ -578,18 +1324,18 @@ inline void printState(const MachineState* state, word memorySize) {
     printf("\tpc = %d\n", state->pc);
 
     printf("\tReservation stations:\n");
-    for (i = 0; i < NUMUNITS; i++) {
+    for (i = 0; i < state->config.numUnits(); i++) {
         if (state->reservation[i].busy == true) {
             printf("\t\tReservation station %d: ", i);
             if (state->reservation[i].Qj == 0) {
                 printf("Vj = %d ", state->reservation[i].Vj);
             } else {
-                printf("Qj = '%s' ", unitname[state->reservation[i].Qj - 1]);
+                printf("Qj = '%s' ", state->config.unitName(state->reservation[i].Qj).c_str());
             }
             if (state->reservation[i].Qk == 0) {
                 printf("Vk = %d ", state->reservation[i].Vk);
             } else {
-                printf("Qk = '%s' ", unitname[state->reservation[i].Qk - 1]);
+                printf("Qk = '%s' ", state->config.unitName(state->reservation[i].Qk).c_str());
             }
             printf(" ExTimeLeft = %d  ROB Index = %d\n", state->reservation[i].exTimeLeft,
                    state->reservation[i].robIdx);
@@ -597,12 +1343,12 @@ inline void printState(const MachineState* state, word memorySize) {
     }
 
     printf("\tReorder buffers:\n");
-    for (i = 0; i < ROBSIZE; i++) {
+    for (i = 0; i < state->config.robSize; i++) {
         if (state->rob[i].busy == true) {
             printf("\t\tReorder buffer %d: ", i);
             printf("instr %d  executionUnit '%s'  state %s  valid %d  result %d address %d\n", state->rob[i].instr,
-                   unitname[state->rob[i].execUnit - 1], statename[state->rob[i].instrStatus], state->rob[i].valid,
-                   state->rob[i].result, state->rob[i].address);
+                   state->config.unitName(state->rob[i].execUnit).c_str(), statename[state->rob[i].instrStatus],
+                   state->rob[i].valid, state->rob[i].result, state->rob[i].address);
         }
     }
 
@@ -619,7 +1365,7 @@ inline void printState(const MachineState* state, word memorySize) {
      */
 
     printf("\tBranch target buffer:\n");
-    for (i = 0; i < BTBSIZE; i++) {
+    for (i = 0; i < state->config.btbSize; i++) {
         if (state->btb[i].valid) {
             printf("\t\tEntry %d: PC=%d, Target=%d, Pred=%d\n", i, state->btb[i].branchPc, state->btb[i].targetPc,
                    state->btb[i].branchPred);
@@ -636,3 +1382,54 @@ inline void printState(const MachineState* state, word memorySize) {
         printf("\t\tregFile[%d] = %d\n", i, state->regFile[i]);
     }
 }
+
+inline void printStateJson(const MachineState* state, word memorySize, const RunSummary* summary = nullptr,
+                           bool counters = false) {
+    //* 以 JSON 格式输出寄存器和内存, 便于脚本处理
+    printf("{\"cycles\": %u, \"pc\": %u, \"committed\": %llu, \"ipc\": %.4f", state->cycles, state->pc,
+           (unsigned long long)state->stats.committed,
+           state->cycles ? double(state->stats.committed) / state->cycles : 0.0);
+    printf(", \"branches\": %llu, \"mispredicts\": %llu, \"accuracy\": %.4f",
+           (unsigned long long)state->stats.branches, (unsigned long long)state->stats.mispredicts,
+           state->stats.accuracy());
+    printf(", \"replays\": %llu", (unsigned long long)state->stats.replays);
+    if (state->cache.enabled()) {
+        printf(", \"cacheHits\": %llu, \"cacheMisses\": %llu, \"cacheWritebacks\": %llu, \"hitRate\": %.4f",
+               (unsigned long long)state->stats.cacheHits, (unsigned long long)state->stats.cacheMisses,
+               (unsigned long long)state->stats.cacheWritebacks, state->stats.hitRate());
+    }
+    if (summary) {
+        printf(", \"halted\": %s, \"reason\": \"%s\"", summary->halted ? "true" : "false",
+               stopreasonname[summary->reason]);
+    }
+    if (counters) {
+        const char* sep = "";
+        printf(", \"stats\": {");
+        visitCounters(*state, [&](const char* name, auto value) {
+            if constexpr (std::is_floating_point_v<decltype(value)>)
+                printf("%s\"%s\": %.4f", sep, name, value);
+            else
+                printf("%s\"%s\": %llu", sep, name, (unsigned long long)value);
+            sep = ", ";
+        });
+        printf(", \"unitBusy\": {");
+        for (word unit = 1; unit <= state->config.numUnits(); unit++) {
+            printf(unit == 1 ? "\"%s\": %llu" : ", \"%s\": %llu", state->config.unitName(unit).c_str(),
+                   (unsigned long long)state->unitBusy[unit]);
+        }
+        printf("}, \"robOccupancy\": [");
+        for (word n = 0; n < state->robOccupancy.size(); n++) {
+            printf(n == 0 ? "%llu" : ", %llu", (unsigned long long)state->robOccupancy[n]);
+        }
+        printf("]}");
+    }
+    printf(", \"regFile\": [");
+    for (word i = 0; i < NUMREGS; i++) {
+        printf(i == 0 ? "%d" : ", %d", (int)state->regFile[i]);
+    }
+    printf("], \"memory\": [");
+    for (word i = 0; i < memorySize; i++) {
+        printf(i == 0 ? "%d" : ", %d", (int)state->memory[i]);
+    }
+    printf("]}\n");
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "defines.hpp"
+#include "error.hpp"
+#include "state.hpp"
+
+struct SweepResult {          /* 参数扫描中一次运行的结果 */
+    MachineConfig config{};   /* 本次运行的机器参数 */
+    uint64_t cycles = 0;      /* 运行的周期数 */
+    uint64_t committed = 0;   /* 提交的指令数 */
+    uint64_t branches = 0;    /* 提交的分支指令数 */
+    uint64_t mispredicts = 0; /* 分支预测错误的次数 */
+    uint64_t stalls = 0;      /* 发射阻塞的周期数 */
+    uint64_t cacheHits = 0;   /* 数据缓存命中次数 */
+    uint64_t cacheMisses = 0; /* 数据缓存缺失次数 */
+    bool halted = false;      /* 是否在周期上限之前 halt */
+    std::string error{};      /* 运行出错时的信息, 成功时为空 */
+
+    double ipc() const {
+        return cycles == 0 ? 0.0 : (double)committed / cycles;
+    }
+
+    double accuracy() const {
+        return branches == 0 ? 0.0 : 1.0 - (double)mispredicts / branches;
+    }
+
+    double hitRate() const {
+        return cacheHits + cacheMisses == 0 ? 0.0 : (double)cacheHits / (cacheHits + cacheMisses);
+    }
+};
+
+/*
+ * 带工作窃取的并行循环:
+ * 任务按下标平均分给各线程的双端队列, 线程从自己队列的尾部取任务,
+ * 队列为空时从其他线程队列的头部窃取, 以平衡长短不一的模拟.
+ * 运行期间不会产生新任务, 所以所有队列都为空时即可结束.
+ */
+template <class F> void parallelFor(size_t numTasks, unsigned threads, F&& task) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, numTasks);
+    if (threads <= 1) {
+        for (size_t i = 0; i < numTasks; ++i)
+            task(i);
+        return;
+    }
+
+    struct alignas(64) Queue {
+        std::mutex lock{};
+        std::deque<size_t> tasks{};
+    };
+    std::vector<Queue> queues(threads);
+    for (unsigned w = 0; w < threads; ++w)
+        for (size_t i = numTasks * w / threads; i < numTasks * (w + 1) / threads; ++i)
+            queues[w].tasks.push_back(i);
+
+    auto take = [&](unsigned w, size_t& out) {
+        {
+            std::lock_guard<std::mutex> guard(queues[w].lock);
+            if (!queues[w].tasks.empty()) {
+                out = queues[w].tasks.back();
+                queues[w].tasks.pop_back();
+                return true;
+            }
+        }
+        for (unsigned k = 1; k < threads; ++k) {
+            auto& victim = queues[(w + k) % threads];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                out = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<std::thread> workers{};
+    workers.reserve(threads);
+    for (unsigned w = 0; w < threads; ++w) {
+        workers.emplace_back([&, w] {
+            size_t i = 0;
+            while (take(w, i))
+                task(i);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+}
+
+inline SweepResult sweepOne(const MachineState& program, const MachineConfig& config, uint64_t maxCycles) {
+    //* 以 `config` 新建机器, 载入 `program` 的内存, pc 和寄存器后运行至 halt
+    SweepResult result{};
+    result.config = config;
+    try {
+        MachineState state{config};
+        if (program.memorySize > state.memory.size())
+            throw TomasuloError("Program of", program.memorySize, "words does not fit in memory of",
+                                state.memory.size());
+        state.memory.copyPages(program.memory);
+        state.pc = program.pc;
+        state.regFile = program.regFile;
+        state.setMemorySize(program.memorySize);
+        state.uops = program.uops;
+
+        auto summary = state.run(maxCycles);
+        result.cycles = summary.cycles;
+        result.committed = summary.committed;
+        result.halted = summary.halted;
+        result.branches = state.stats.branches;
+        result.mispredicts = state.stats.mispredicts;
+        result.stalls = state.stats.stalls;
+        result.cacheHits = state.stats.cacheHits;
+        result.cacheMisses = state.stats.cacheMisses;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+inline std::vector<SweepResult> sweep(const MachineState& program, const std::vector<MachineConfig>& configs,
+                                      uint64_t maxCycles = UINT64_MAX, unsigned threads = 0) {
+    /*
+     * 在线程池上用每组参数各运行一次 `program`, 结果的顺序与 `configs` 一致.
+     * `program` 只提供初始的内存, pc 和寄存器, 它的周期数等运行状态会被忽略.
+     * 某组参数出错时只记录在对应结果的 `error` 中, 不影响其他运行.
+     */
+    std::vector<SweepResult> results(configs.size());
+    parallelFor(configs.size(), threads,
+                [&](size_t i) { results[i] = sweepOne(program, configs[i], maxCycles); });
+    return results;
+}
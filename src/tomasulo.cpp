@@ -3,12 +3,23 @@
 
 #include <stdarg.h>
 
+#include "assembler.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
+#include "checkpoint.hpp"
+#include "config.hpp"
 #include "decode.hpp"
 #include "defines.hpp"
 #include "error.hpp"
+#include "history.hpp"
+#include "simd.hpp"
+#include "simpoint.hpp"
 #include "state.hpp"
+#include "sweep.hpp"
+#include "trace.hpp"
 
 #include "pybind11/attr.h"
+#include "pybind11/numpy.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
 
@@ -16,14 +27,121 @@ namespace py = pybind11;
 
 #define d_cls(prop, cls) c.def_readwrite(#prop, &cls::prop);
 
+template <class Table> py::array_t<typename Table::value_type> arrayView(Table& arr, py::handle base) {
+    //* 以 `base` 为所有者, 不复制地将 `arr` 暴露为 numpy 数组; 构造之后各表的长度不再改变
+    return py::array_t<typename Table::value_type>(arr.size(), arr.data(), base);
+}
+
+template <class Table>
+void arrayAssign(Table& arr,
+                 py::array_t<typename Table::value_type, py::array::c_style | py::array::forcecast> value) {
+    if ((size_t)value.size() != arr.size())
+        throw TomasuloError("Expected", arr.size(), "elements, got", value.size());
+    memcpy(arr.data(), value.data(), arr.size() * sizeof(typename Table::value_type));
+}
+
+template <class T, class Rebuild>
+void tableAssign(std::vector<T>& table, const std::vector<T>& value, Rebuild rebuild) {
+    /*
+     * 原地替换一张表并重建由它派生的状态. 不允许改变长度, 否则 `<prop>View` 会指向已释放的内存;
+     * 重建时检查出无效的项则恢复原表, 使机器状态保持一致
+     */
+    if (value.size() != table.size())
+        throw TomasuloError("Expected", table.size(), "elements, got", value.size());
+    auto saved = table;
+    std::copy(value.begin(), value.end(), table.begin());
+    try {
+        rebuild();
+    } catch (...) {
+        std::copy(saved.begin(), saved.end(), table.begin());
+        rebuild();
+        throw;
+    }
+}
+
+// 可读写的 numpy 视图, 用于 `word` 数组
+#define d_array(prop, cls)                                                                                            \
+    c.def_property(                                                                                                    \
+        #prop, [](py::object self) { return arrayView(self.cast<cls&>().prop, self); },                              \
+        [](cls& self, py::array_t<word, py::array::c_style | py::array::forcecast> value) {                          \
+            arrayAssign(self.prop, value);                                                                             \
+        });
+// 结构化 dtype 的 numpy 视图, 名为 `<prop>View`
+#define d_view(prop, cls)                                                                                             \
+    c.def_property_readonly(#prop "View", [](py::object self) { return arrayView(self.cast<cls&>().prop, self); });
+// 只读的结构化视图, 用于带有派生状态的表, 修改需经过检查并重建派生状态的 `<prop>` 属性
+#define d_const_view(prop, cls)                                                                                       \
+    c.def_property_readonly(#prop "View", [](py::object self) {                                                       \
+        auto view = arrayView(self.cast<cls&>().prop, self);                                                           \
+        view.attr("flags").attr("writeable") = false;                                                                  \
+        return view;                                                                                                   \
+    });
+
 PYBIND11_MODULE(tomasulo, m) {
     m.doc() = "a naive c++ implementation of Tomasulo algorithm";
+    m.attr("COUNTERS") = COUNTERS;
+
+    PYBIND11_NUMPY_DTYPE(ResStation, busy, instr, Vj, Vk, Qj, Qk, exTimeLeft, robIdx);
+    PYBIND11_NUMPY_DTYPE(ROBEntry, busy, valid, replay, pc, instr, execUnit, instrStatus, result, address);
+    PYBIND11_NUMPY_DTYPE(RegResultEntry, valid, robIdx);
+    PYBIND11_NUMPY_DTYPE(BTBEntry, valid, branchPred, branchPc, targetPc);
+    PYBIND11_NUMPY_DTYPE(TageEntry, tag, ctr, useful);
+    PYBIND11_NUMPY_DTYPE(CacheLine, valid, dirty, tag);
+    PYBIND11_NUMPY_DTYPE(TraceRecord, cycle, event, unit, robIdx, pc, value);
 
     py::enum_<BHT>(m, "BHT")
         .value("STRONGNOT", BHT::STRONGNOT)
         .value("WEAKNOT", BHT::WEAKNOT)
         .value("WEAKTAKEN", BHT::WEAKTAKEN)
         .value("STRONGTAKEN", BHT::STRONGTAKEN);
+    py::enum_<StopReason>(m, "StopReason")
+        .value("HALTED", StopReason::HALTED)
+        .value("BREAKPOINT", StopReason::BREAKPOINT)
+        .value("WATCHPOINT", StopReason::WATCHPOINT)
+        .value("CYCLE_LIMIT", StopReason::CYCLE_LIMIT)
+        .value("INSTR_LIMIT", StopReason::INSTR_LIMIT);
+    py::enum_<PredictorKind>(m, "PredictorKind")
+        .value("BIMODAL", PredictorKind::BIMODAL)
+        .value("GSHARE", PredictorKind::GSHARE)
+        .value("TOURNAMENT", PredictorKind::TOURNAMENT)
+        .value("TAGE", PredictorKind::TAGE);
+    py::enum_<BTBReplacement>(m, "BTBReplacement")
+        .value("LRU", BTBReplacement::LRU)
+        .value("PLRU", BTBReplacement::PLRU);
+    py::enum_<BranchRecovery>(m, "BranchRecovery")
+        .value("COMMIT", BranchRecovery::COMMIT)
+        .value("WRITEBACK", BranchRecovery::WRITEBACK);
+    py::enum_<TraceEvent>(m, "TraceEvent")
+        .value("EV_ISSUE", TraceEvent::EV_ISSUE)
+        .value("EV_EXECUTE", TraceEvent::EV_EXECUTE)
+        .value("EV_BROADCAST", TraceEvent::EV_BROADCAST)
+        .value("EV_COMMIT", TraceEvent::EV_COMMIT)
+        .value("EV_SQUASH", TraceEvent::EV_SQUASH)
+        .value("EV_BTB", TraceEvent::EV_BTB)
+        .value("EV_MEMWRITE", TraceEvent::EV_MEMWRITE);
+    py::enum_<SimdLevel>(m, "SimdLevel")
+        .value("SIMD_SCALAR", SimdLevel::SIMD_SCALAR)
+        .value("SIMD_SSE2", SimdLevel::SIMD_SSE2)
+        .value("SIMD_AVX2", SimdLevel::SIMD_AVX2);
+    {
+        auto c = py::class_<StopCondition>(m, "StopCondition")
+                     .def(py::init([](word breakPc, word watchAddr) { return StopCondition{breakPc, watchAddr}; }),
+                          py::arg("breakPc") = INVALID, py::arg("watchAddr") = INVALID);
+#define d(prop) d_cls(prop, StopCondition)
+        d(breakPc);
+        d(watchAddr);
+#undef d
+    }
+    {
+        auto c = py::class_<RunSummary>(m, "RunSummary").def(py::init());
+#define d(prop) d_cls(prop, RunSummary)
+        d(cycles);
+        d(committed);
+        d(halted);
+        d(reason);
+#undef d
+        c.def_property_readonly("ipc", &RunSummary::ipc);
+    }
     {
         auto c = py::class_<ResStation>(m, "ResStation").def(py::init());
 #define d(prop) d_cls(prop, ResStation)
@@ -42,6 +160,7 @@ PYBIND11_MODULE(tomasulo, m) {
 #define d(prop) d_cls(prop, ROBEntry)
         d(busy);
         d(valid);
+        d(replay);
         d(pc);
         d(instr);
         d(execUnit);
@@ -67,30 +186,377 @@ PYBIND11_MODULE(tomasulo, m) {
 #undef d
     }
     {
-        auto c = py::class_<MachineState>(m, "MachineState").def(py::init());
+        auto c = py::class_<MachineConfig>(m, "MachineConfig").def(py::init());
+
+        c.doc() = "geometry and latencies of a `MachineState`";
+        c.def("numUnits", &MachineConfig::numUnits);
+        c.def("unitName", &MachineConfig::unitName);
+        c.def("validate", &MachineConfig::validate);
+        c.def_static("parse", &MachineConfig::parse, py::arg("text"), py::arg("source") = "<string>");
+        c.def_static("fromFile", &MachineConfig::fromFile);
+#define d(prop) d_cls(prop, MachineConfig)
+        d(robSize);
+        d(numLoad);
+        d(numStore);
+        d(numInt);
+        d(btbSize);
+        d(btbWays);
+        d(btbReplacement);
+        d(btbTagBits);
+        d(memSize);
+        d(memCopyOnWrite);
+        d(intExec);
+        d(loadExec);
+        d(storeExec);
+        d(branchExec);
+        d(issueWidth);
+        d(commitWidth);
+        d(numCDB);
+        d(predictor);
+        d(phtBits);
+        d(historyBits);
+        d(branchRecovery);
+        d(recoveryLatency);
+        d(cacheSize);
+        d(cacheWays);
+        d(cacheLineWords);
+        d(cacheWriteBack);
+        d(cacheWriteAllocate);
+        d(cacheHitLatency);
+        d(cacheMissLatency);
+#undef d
+    }
+    {
+        auto c = py::class_<BranchPredictor>(m, "BranchPredictor");
+
+        c.doc() = "branch direction predictor, its tables are exposed as numpy views";
+        c.def_readonly("kind", &BranchPredictor::kind);
+        c.def_readonly("history", &BranchPredictor::history);
+        c.def_readonly("specHistory", &BranchPredictor::specHistory);
+        d_view(pht, BranchPredictor);
+        d_view(local, BranchPredictor);
+        d_view(chooser, BranchPredictor);
+        d_view(tagged, BranchPredictor);
+    }
+    {
+        auto c = py::class_<DataCache>(m, "DataCache");
+
+        c.doc() = "timing model of the L1 data cache, its tags and LRU state are exposed as numpy views";
+        c.def("enabled", &DataCache::enabled);
+        d_view(lines, DataCache);
+        d_view(repl, DataCache);
+    }
+    {
+        auto c = py::class_<MachineState>(m, "MachineState").def(py::init()).def(py::init<const MachineConfig&>());
 
         c.doc() = "class that represents state of the machine";
         c.def("__copy__", [](const MachineState& self) { return decltype(self)(self); });
         c.def("copy", [](const MachineState& self) { return decltype(self)(self); });
         c.def("__deepcopy__", [](const MachineState& self, py::dict) { return decltype(self)(self); });
         c.def("nextStep", &MachineState::nextStep);
+        c.def("run", &MachineState::run, py::arg("maxCycles"), py::arg("cond") = StopCondition{},
+              py::call_guard<py::gil_scoped_release>());
+        c.def("runUntilHalt", &MachineState::runUntilHalt, py::arg("maxCycles") = UINT64_MAX,
+              py::call_guard<py::gil_scoped_release>());
+        c.def("fastForward", &MachineState::fastForward, py::arg("maxInstrs"), py::arg("cond") = StopCondition{},
+              py::arg("warm") = true, py::call_guard<py::gil_scoped_release>(),
+              "execute up to `maxInstrs` instructions functionally, without timing, then continue with `run`");
         c.def("loadInstr", &MachineState::loadInstr);
+        c.def("loadProgram", &MachineState::loadProgram, py::arg("text"), py::arg("source") = "<string>",
+              py::call_guard<py::gil_scoped_release>(), "assemble `text` and load it at `pc`, returns its length");
+        c.def("loadBinary", &MachineState::loadBinary, py::arg("data"), py::call_guard<py::gil_scoped_release>(),
+              "load a binary produced by `scripts/assembler.py` at `pc`, returns its length");
         c.def("setMemorySize", &MachineState::setMemorySize);
+        c.def("save", &saveCheckpoint, py::arg("path"), py::call_guard<py::gil_scoped_release>());
+        c.def_static("load", &loadCheckpoint, py::arg("path"), py::call_guard<py::gil_scoped_release>());
+        // 所有计数器, 以及按单元名称索引的忙碌周期数和 ROB 占用的直方图
+        c.def("stats", [](const MachineState& self) {
+            py::dict ret{};
+            visitCounters(self, [&](const char* name, auto value) { ret[name] = value; });
+            py::dict busy{};
+            for (word unit = 1; unit <= self.config.numUnits(); unit++)
+                busy[py::str(self.config.unitName(unit))] = self.unitBusy[unit];
+            ret["unitBusy"] = busy;
+            ret["robOccupancy"] = self.robOccupancy;
+            return ret;
+        });
+        c.def("startTrace", &MachineState::startTrace, py::arg("path"));
+        c.def("stopTrace", &MachineState::stopTrace, py::call_guard<py::gil_scoped_release>());
+        c.def_readonly("config", &MachineState::config);
+        c.def_readonly("predictor", &MachineState::predictor);
+        c.def_readonly("cache", &MachineState::cache);
 
 #define d(prop) d_cls(prop, MachineState)
         d(pc);
         d(cycles);
-        d(reservation);
-        d(rob);
-        d(btb);
-        d(memory);
-        d(regFile);
+        d(fetchStall);
         d(regResult);
 #undef d
+        d_array(regFile, MachineState);
+        // 整体替换 ROB, 保留栈或 BTB 后检查各项并重建派生的状态; 对应的 `<prop>View` 是只读的
+        c.def_property(
+            "rob", [](const MachineState& self) { return self.rob; },
+            [](MachineState& self, const std::vector<ROBEntry>& value) {
+                tableAssign(self.rob, value, [&] { self.rebuildRobIndex(); });
+            });
+        c.def_property(
+            "reservation", [](const MachineState& self) { return self.reservation; },
+            [](MachineState& self, const std::vector<ResStation>& value) {
+                tableAssign(self.reservation, value, [&] { self.rebuildReservationIndex(); });
+            });
+        c.def_property(
+            "btb", [](const MachineState& self) { return self.btb; },
+            [](MachineState& self, const std::vector<BTBEntry>& value) {
+                tableAssign(self.btb, value, [&] { self.checkBtb(); });
+            });
+        c.def_property(
+            "btbRepl", [](const MachineState& self) { return self.btbRepl; },
+            [](MachineState& self, const std::vector<uint64_t>& value) {
+                tableAssign(self.btbRepl, value, [&] { self.checkBtb(); });
+            });
+        // 分页内存不连续: `memory` 复制出整个地址空间 [0, memSize) 的只读快照, 与原来的数组含义相同;
+        // 地址空间为完整 32 位时太大, 只能用 `readMemory` 复制一段或用 `memoryPage` 按页查看.
+        // 修改内存需使用 `writeMemory` 或对 `memory` 整体赋值
+        c.def(
+            "readMemory",
+            [](const MachineState& self, word address, word count) {
+                if (address + uint64_t(count) > self.memory.size())
+                    throw TomasuloError("Range", address, "+", count, "is out of memory");
+                py::array_t<word> ret(count);
+                self.memory.readRange(address, ret.mutable_data(), count);
+                return ret;
+            },
+            py::arg("address"), py::arg("count"));
+        c.def(
+            "writeMemory",
+            [](MachineState& self, word address, py::array_t<word, py::array::c_style | py::array::forcecast> values) {
+                if (address + uint64_t(values.size()) > self.memory.size())
+                    throw TomasuloError("Range", address, "+", values.size(), "is out of memory");
+                self.writeMemory(address, values.data(), values.size());
+            },
+            py::arg("address"), py::arg("values"));
+        c.def_property(
+            "memory",
+            [](const MachineState& self) {
+                if (!self.config.memSize)
+                    throw TomasuloError("Memory spans the whole 32-bit address space, use readMemory or memoryPage");
+                py::array_t<word> ret(self.memory.size());
+                self.memory.readRange(0, ret.mutable_data(), self.memory.size());
+                ret.attr("flags").attr("writeable") = false;
+                return ret;
+            },
+            [](MachineState& self, py::array_t<word, py::array::c_style | py::array::forcecast> values) {
+                if (uint64_t(values.size()) > self.memory.size())
+                    throw TomasuloError("Expected at most", self.memory.size(), "elements, got", values.size());
+                self.writeMemory(0, values.data(), values.size());
+            });
+        c.def_property_readonly("memoryPages", [](const MachineState& self) { return self.memory.pageCount(); });
+        // 第 `number` 页 (地址 [number * 1024, (number + 1) * 1024)) 的只读视图, 不复制;
+        // 视图与状态共享该页, 状态之后写入该页时会另复制一份, 所以视图的内容保持为取出时的值
+        c.def(
+            "memoryPage",
+            [](const MachineState& self, word number) {
+                if (uint64_t(number) << PAGEBITS >= self.memory.size())
+                    throw TomasuloError("Page", number, "is out of memory");
+                auto page = self.memory.sharedPage(number);
+                py::array_t<word> ret;
+                if (page) {
+                    using Owner = std::shared_ptr<const Page>;
+                    auto base = py::capsule(new Owner(page), [](void* p) { delete static_cast<Owner*>(p); });
+                    ret = py::array_t<word>(PAGEWORDS, page->data(), base);
+                } else {
+                    ret = py::array_t<word>(PAGEWORDS);
+                    std::fill_n(ret.mutable_data(), PAGEWORDS, 0);
+                }
+                ret.attr("flags").attr("writeable") = false;
+                return ret;
+            },
+            py::arg("number"));
+        d_const_view(reservation, MachineState);
+        d_const_view(rob, MachineState);
+        d_const_view(btb, MachineState);
+        d_const_view(btbRepl, MachineState);
+        d_const_view(regResult, MachineState);
+    }
+
+    {
+        auto c = py::class_<History>(m, "History")
+                     .def(py::init<const MachineState&, word>(), py::arg("initial"), py::arg("keyframeInterval") = 1024);
+
+        c.doc() = "per-cycle history of a `MachineState`, stored as deltas with periodic keyframes";
+        c.def("record", &History::record);
+        c.def("seek", &History::seek);
+        c.def("stepBack", &History::stepBack);
+        c.def("stepForward", &History::stepForward);
+        c.def("current", &History::current);
+        c.def("latest", &History::latest);
+        c.def("memoryUsage", &History::memoryUsage);
+        c.def("__len__", &History::size);
+    }
+
+    {
+        auto c = py::class_<TraceReader>(m, "TraceReader").def(py::init<const std::string&>(), py::arg("path"));
+
+        c.doc() = "streaming reader of a trace written by `MachineState.startTrace`, iterating yields numpy chunks";
+        c.def("size", &TraceReader::size);
+        c.def("tell", &TraceReader::tell);
+        c.def("seek", &TraceReader::seek, py::arg("index"));
+        // 读取时释放 GIL, GUI 可以在另一个线程中回放
+        auto readChunk = [](TraceReader& self, size_t count) {
+            py::array_t<TraceRecord> ret(std::min<uint64_t>(count, self.size() - self.tell()));
+            auto out = ret.mutable_data();
+            size_t n = ret.size();
+            {
+                py::gil_scoped_release release{};
+                self.read(out, n);
+            }
+            return ret;
+        };
+        c.def("read", readChunk, py::arg("count") = TRACE_BUFFER);
+        c.def("__len__", &TraceReader::size);
+        c.def("__iter__", [](py::object self) { return self; });
+        c.def("__next__", [readChunk](TraceReader& self) {
+            if (self.tell() == self.size())
+                throw py::stop_iteration();
+            return readChunk(self, TRACE_BUFFER);
+        });
+    }
+
+    {
+        auto c = py::class_<SweepResult>(m, "SweepResult");
+
+        c.doc() = "result of one run in a parameter sweep";
+#define d(prop) c.def_readonly(#prop, &SweepResult::prop);
+        d(config);
+        d(cycles);
+        d(committed);
+        d(branches);
+        d(mispredicts);
+        d(stalls);
+        d(cacheHits);
+        d(cacheMisses);
+        d(halted);
+        d(error);
+#undef d
+        c.def_property_readonly("ipc", &SweepResult::ipc);
+        c.def_property_readonly("accuracy", &SweepResult::accuracy);
+        c.def_property_readonly("hitRate", &SweepResult::hitRate);
     }
 
+    m.def("sweep", &sweep, py::arg("program"), py::arg("configs"), py::arg("maxCycles") = UINT64_MAX,
+          py::arg("threads") = 0, py::call_guard<py::gil_scoped_release>(),
+          "run `program` once per config on a work-stealing thread pool, results follow the order of `configs`");
+    {
+        auto c = py::class_<MachineBatch>(m, "MachineBatch")
+                     .def(py::init<const MachineState&, word, unsigned>(), py::arg("program"), py::arg("count"),
+                          py::arg("threads") = 0);
+
+        c.doc() = "copies of `program` advanced in lockstep: instances with the same control state share one "
+                  "pipeline and differ only in data columns, splitting where their data changes control flow";
+        c.def("__len__", &MachineBatch::size);
+        // 实例由组的控制状态与各自的数据拼成, 所以取出的是副本, 修改之后需整体赋值回去
+        c.def("__getitem__", &MachineBatch::instance);
+        c.def("__setitem__", &MachineBatch::setInstance);
+        c.def("step", &MachineBatch::step, py::call_guard<py::gil_scoped_release>(),
+              "advance every running instance by one cycle, returns whether all have stopped");
+        c.def("run", &MachineBatch::run, py::arg("maxCycles"), py::call_guard<py::gil_scoped_release>(),
+              "advance every running instance by up to `maxCycles` cycles, returns whether all have stopped");
+        c.def(
+            "readMemory",
+            [](const MachineBatch& self, word index, word address, word count) {
+                auto values = self.readMemory(index, address, count);
+                return py::array_t<word>(values.size(), values.data());
+            },
+            py::arg("index"), py::arg("address"), py::arg("count"));
+        c.def(
+            "writeMemory",
+            [](MachineBatch& self, word index, word address,
+               py::array_t<word, py::array::c_style | py::array::forcecast> values) {
+                self.writeMemory(index, address, values.data(), values.size());
+            },
+            py::arg("index"), py::arg("address"), py::arg("values"));
+        c.def_property_readonly("numGroups", &MachineBatch::numGroups);
+        c.def("isRunning", &MachineBatch::isRunning);
+        c.def("setRunning", &MachineBatch::setRunning, py::arg("index"), py::arg("on"));
+        c.def_property_readonly("numRunning", &MachineBatch::numRunning);
+        c.def("counter", [](const MachineBatch& self, const std::string& name) {
+            auto values = self.counter(name);
+            return py::array_t<double>(values.size(), values.data());
+        });
+        // 寄存器表为 (实例数, NUMREGS) 的二维视图, 即各实例的寄存器本身
+        c.def_property_readonly("regFile", [](py::object self) {
+            auto& batch = self.cast<MachineBatch&>();
+            return py::array_t<word>({(size_t)batch.size(), (size_t)NUMREGS}, batch.regs.data(), self);
+        });
+        c.def_property_readonly("pc", [](py::object self) { return arrayView(self.cast<MachineBatch&>().pcs, self); });
+#define d(prop) \
+    c.def_property_readonly(#prop, [](py::object self) { return arrayView(self.cast<MachineBatch&>().prop, self); });
+        d(cycles);
+        d(committed);
+        d(halted);
+#undef d
+    }
+    {
+        auto c = py::class_<SimPointSample>(m, "SimPointSample");
+
+        c.doc() = "an interval simulated in detail by `simpoint`";
+#define d(prop) c.def_readonly(#prop, &SimPointSample::prop);
+        d(interval);
+        d(cluster);
+        d(cycles);
+        d(committed);
+#undef d
+        c.def_property_readonly("cpi", &SimPointSample::cpi);
+    }
+    {
+        auto c = py::class_<SimPointResult>(m, "SimPointResult");
+
+        c.doc() = "weighted CPI estimate of a sampled simulation";
+#define d(prop) c.def_readonly(#prop, &SimPointResult::prop);
+        d(interval);
+        d(instructions);
+        d(clusters);
+        d(labels);
+        d(weights);
+        d(samples);
+        d(detailed);
+        d(cpi);
+        d(cpiError);
+        d(truncated);
+#undef d
+        c.def_property_readonly("ipc", &SimPointResult::ipc);
+    }
+    m.def(
+        "simpoint",
+        [](const MachineState& program, uint64_t interval, word clusters, word samples, uint64_t warmup, uint64_t seed,
+           uint64_t maxInstructions, unsigned threads) {
+            return simpoint(program, {interval, clusters, samples, warmup, seed, maxInstructions}, threads);
+        },
+        py::arg("program"), py::arg("interval") = SimPointOptions{}.interval,
+        py::arg("clusters") = SimPointOptions{}.clusters, py::arg("samples") = SimPointOptions{}.samples,
+        py::arg("warmup") = SimPointOptions{}.warmup, py::arg("seed") = SimPointOptions{}.seed,
+        py::arg("maxInstructions") = SimPointOptions{}.maxInstructions, py::arg("threads") = 0,
+        py::call_guard<py::gil_scoped_release>(),
+        "cluster the basic block vectors of `program` and simulate `samples` intervals per cluster in detail");
+    m.def(
+        "assemble",
+        [](const std::string& text, const std::string& source) {
+            std::vector<word> words{};
+            {
+                py::gil_scoped_release release{};
+                words = Assembler::assemble(text, source);
+            }
+            return py::array_t<word>(words.size(), words.data());
+        },
+        py::arg("text"), py::arg("source") = "<string>", "assemble `text` into an array of instructions");
     m.def("printState", &printState, "print the state of given `MachineState`");
+    m.def("simdLevel", [] { return simdLevel; }, "the instruction set used by the load/store queue search");
+    m.def("setSimdLevel", &setSimdLevel, py::arg("level"),
+          "use at most `level` for the load/store queue search, returns the level actually used");
     py::register_exception<TomasuloError>(m, "TomasuloError");
 }
 
+#undef d_view
+#undef d_const_view
+#undef d_array
 #undef d_cls
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "defines.hpp"
+#include "error.hpp"
+
+/*
+ * 流水线事件的二进制跟踪文件 (小端, 与本机结构体布局一致):
+ *   文件头: 8 字节魔数, u32 版本号, u32 记录大小
+ *   之后是连续的定长 `TraceRecord`, 按周期递增, 同一周期内按事件发生的顺序排列
+ * 记录定长, 因此可以按下标跳转, 也可以直接读成结构体数组或 numpy 数组.
+ * 结构体的布局改变时需要增加 TRACE_VERSION.
+ */
+constexpr char TRACE_MAGIC[8] = {'T', 'O', 'M', 'A', 'T', 'R', 'C', 'E'};
+constexpr uint32_t TRACE_VERSION = 1;
+constexpr size_t TRACE_BUFFER = 1 << 16; /* 每块缓冲的记录数, 即 1 MB */
+constexpr size_t TRACE_PENDING = 8;      /* 最多积压的块数, 写入跟不上时模拟会等待 */
+
+/*
+ * 跟踪的事件, 各事件中 `pc` 与 `value` 的含义:
+ */
+enum TraceEvent {
+    EV_ISSUE = 0,     /* 发射: pc 为指令地址, value 为指令 */
+    EV_EXECUTE = 1,   /* 开始执行: value 为执行所需的周期数 */
+    EV_BROADCAST = 2, /* 结果送上公共数据总线: value 为结果 */
+    EV_COMMIT = 3,    /* 提交: value 为结果 */
+    EV_SQUASH = 4,    /* 清除错误路径: 由 robIdx 处的分支或 load 引起, pc 为新的取指地址, value 为清除的更年轻指令数 */
+    EV_BTB = 5,       /* 更新分支预测缓冲栈: pc 为分支地址, value 为目标地址, unit 为实际方向 */
+    EV_MEMWRITE = 6,  /* store 写内存: pc 为地址, value 为写入的值 */
+};
+inline const char* traceeventname[7] = {"issue", "execute", "broadcast", "commit",
+                                        "squash", "btb",     "memwrite"}; /* 事件名称 */
+constexpr word NUMTRACEEVENTS = 7;
+
+struct TraceRecord { /* 跟踪文件中的一条记录 */
+    word cycle;      /* 事件发生的周期 */
+    uint8_t event;   /* `TraceEvent` */
+    uint8_t unit;    /* 执行单元编号 */
+    uint16_t robIdx; /* ROB 项编号, 打开跟踪时要求 robSize 不超过 65536 */
+    word pc;
+    word value;
+};
+static_assert(sizeof(TraceRecord) == 16, "trace records must stay 16 bytes");
+
+/*
+ * 异步的跟踪写入器:
+ * 模拟线程只把记录追加到当前块, 块满后交给后台线程写入文件, 自己换一块空的继续.
+ * 写完的块回收再用, 稳定之后不再分配内存.
+ * 后台线程写入失败时, 错误在模拟线程下一次交出块或 `close` 时以 TomasuloError 抛出.
+ */
+class TraceWriter {
+  public:
+    explicit TraceWriter(const std::string& path) : fout(path, std::ios::binary | std::ios::trunc), path(path) {
+        if (!fout)
+            throw TomasuloError("Cannot open", path);
+        uint32_t recordSize = sizeof(TraceRecord);
+        fout.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        fout.write((const char*)&TRACE_VERSION, sizeof(TRACE_VERSION));
+        fout.write((const char*)&recordSize, sizeof(recordSize));
+        current.resize(TRACE_BUFFER);
+        worker = std::thread([this] { loop(); });
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    ~TraceWriter() {
+        try {
+            close();
+        } catch (const TomasuloError&) {
+            // 析构时无法报告错误, 需要检查错误的调用者应先 `close`
+        }
+    }
+
+    void push(const TraceRecord& record) {
+        current[filled++] = record;
+        if (filled == TRACE_BUFFER)
+            submit();
+    }
+
+    uint64_t count() const {
+        //* 已追加的记录数
+        return submitted + filled;
+    }
+
+    void flush() {
+        //* 交出当前块并等待所有块写入文件
+        submit();
+        std::unique_lock<std::mutex> guard(lock);
+        drained.wait(guard, [&] { return pending.empty() && !writing; });
+        check();
+    }
+
+    void close() {
+        //* 写完所有记录并关闭文件, 可以重复调用
+        if (!worker.joinable())
+            return;
+        submit();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_one();
+        worker.join();
+        fout.close();
+        std::lock_guard<std::mutex> guard(lock);
+        check();
+    }
+
+  private:
+    std::ofstream fout;
+    std::string path;
+    std::vector<TraceRecord> current{};            /* 模拟线程正在填写的块, 长度固定为 TRACE_BUFFER */
+    size_t filled = 0;                             /* `current` 中已填写的记录数 */
+    uint64_t submitted = 0;                        /* 已交出的记录数 */
+    std::mutex lock{};                             /* 保护以下各项 */
+    std::condition_variable ready{};               /* 有块待写或需要停止 */
+    std::condition_variable drained{};             /* 有块写完 */
+    std::deque<std::vector<TraceRecord>> pending{}; /* 等待写入的块 */
+    std::vector<std::vector<TraceRecord>> spare{};  /* 写完回收的空块 */
+    bool writing = false;
+    bool stopping = false;
+    std::string error{};
+    std::thread worker{};
+
+    void check() const {
+        //* 调用者持有 `lock`
+        if (!error.empty())
+            throw TomasuloError(error);
+    }
+
+    void submit() {
+        if (filled == 0)
+            return;
+        std::unique_lock<std::mutex> guard(lock);
+        drained.wait(guard, [&] { return pending.size() < TRACE_PENDING || !error.empty(); });
+        check();
+        current.resize(filled);
+        submitted += filled;
+        filled = 0;
+        pending.push_back(std::move(current));
+        if (spare.empty()) {
+            current = std::vector<TraceRecord>(TRACE_BUFFER);
+        } else {
+            current = std::move(spare.back());
+            spare.pop_back();
+        }
+        guard.unlock();
+        ready.notify_one();
+    }
+
+    void loop() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            ready.wait(guard, [&] { return !pending.empty() || stopping; });
+            if (pending.empty())
+                return;
+            auto block = std::move(pending.front());
+            pending.pop_front();
+            writing = true;
+            guard.unlock();
+            bool ok = error.empty() && fout.write((const char*)block.data(), block.size() * sizeof(TraceRecord));
+            guard.lock();
+            writing = false;
+            if (!ok && error.empty())
+                error = "Failed to write trace " + path;
+            block.resize(TRACE_BUFFER);
+            spare.push_back(std::move(block));
+            drained.notify_all();
+        }
+    }
+};
+
+/*
+ * 跟踪文件的流式读取:
+ * 按块读取记录, 不需要把整个文件读入内存.
+ */
+class TraceReader {
+  public:
+    explicit TraceReader(const std::string& path) : fin(path, std::ios::binary), path(path) {
+        if (!fin)
+            throw TomasuloError("Cannot open", path);
+        char magic[sizeof(TRACE_MAGIC)];
+        uint32_t version = 0, recordSize = 0;
+        fin.read(magic, sizeof(magic));
+        fin.read((char*)&version, sizeof(version));
+        fin.read((char*)&recordSize, sizeof(recordSize));
+        if (!fin || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+            throw TomasuloError(path + ":", "not a trace file");
+        if (version != TRACE_VERSION || recordSize != sizeof(TraceRecord))
+            throw TomasuloError(path + ":", "unsupported trace version", version);
+        fin.seekg(0, std::ios::end);
+        auto bytes = uint64_t(fin.tellg()) - HEADER;
+        if (bytes % sizeof(TraceRecord) != 0)
+            throw TomasuloError(path + ":", "truncated trace");
+        total = bytes / sizeof(TraceRecord);
+        fin.seekg(HEADER);
+    }
+
+    uint64_t size() const {
+        //* 文件中的记录数
+        return total;
+    }
+
+    uint64_t tell() const {
+        //* 下一次读取的记录下标
+        return position;
+    }
+
+    void seek(uint64_t index) {
+        //* 跳转到第 `index` 条记录
+        if (index > total)
+            throw TomasuloError(path + ":", "record", index, "is out of range");
+        fin.clear();
+        fin.seekg(HEADER + index * sizeof(TraceRecord));
+        position = index;
+    }
+
+    size_t read(TraceRecord* out, size_t count) {
+        //* 读取至多 `count` 条记录, 返回实际读到的条数, 读到文件末尾时返回 0
+        count = (size_t)std::min<uint64_t>(count, total - position);
+        if (count == 0)
+            return 0;
+        if (!fin.read((char*)out, count * sizeof(TraceRecord)))
+            throw TomasuloError(path + ":", "failed to read record", position);
+        position += count;
+        return count;
+    }
+
+  private:
+    static constexpr uint64_t HEADER = sizeof(TRACE_MAGIC) + 2 * sizeof(uint32_t);
+
+    std::ifstream fin;
+    std::string path;
+    uint64_t total = 0;
+    uint64_t position = 0;
+};
+
+/*
+ * 状态持有的跟踪写入器:
+ * 复制状态时不复制跟踪, 以免参数扫描和历史记录中的副本写入同一个文件.
+ */
+struct TraceHook {
+    std::unique_ptr<TraceWriter> writer{};
+
+    TraceHook() = default;
+    TraceHook(const TraceHook&) : writer() {
+    }
+    TraceHook(TraceHook&&) = default;
+    TraceHook& operator=(const TraceHook&) {
+        return *this;
+    }
+    TraceHook& operator=(TraceHook&&) = default;
+};
@@ -5,14 +5,25 @@ add_rules("mode.debug", "mode.release")
 set_languages("cxx17")
 add_cxflags("-Wall", "-Wextra", "-Weffc++", "-Werror")
 
+option("counters")
+    set_default(true)
+    set_showmenu(true)
+    set_description("Update the per-cycle performance counters, disable to compile them out")
+option_end()
+
+if not has_config("counters") then
+    add_defines("TOMASULO_COUNTERS=0")
+end
+
 
 target("tomasulo")
     set_kind("shared")
     set_prefixname("")
-    add_files("src/*.cpp")
+    add_syslinks("pthread")
+    add_files("src/tomasulo.cpp")
 
     on_load(function (target)
-        os.execv("python", {"-m", "pip", "install", "pybind11"})
+        os.execv("python", {"-m", "pip", "install", "pybind11", "numpy"})
         local pyinclude = os.iorunv("python", {"-m", "pybind11", "--includes"})
         for _, inc in ipairs(pyinclude:split(' ')) do
             target:add("cxflags", "-isystem"..inc:sub(3))
@@ -24,6 +35,17 @@ target("tomasulo")
         os.cp(targetfile, path.join("./lib", path.filename(targetfile)))
     end)
 
+target("tomasulo-sim")
+    set_kind("binary")
+    add_files("src/sim.cpp")
+    add_syslinks("pthread")
+
+target("tomasulo-bench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench.cpp")
+    add_includedirs("src")
+
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io